@@ -0,0 +1,359 @@
+
+#include <algorithm>
+#include <cstdio>
+
+#include "chrono.hpp"
+#include "fs.hpp"
+#include "printer.hpp"
+#include "sys.hpp"
+#include "var.hpp"
+
+#include "hal.hpp"
+
+// Results are printed as JSON. Wall time is the cost of HalAPI plus the
+// driver on this machine; device time is the emulator's model of the
+// hardware and is only reported for HAL_API_IS_EMULATED builds.
+class Bench {
+public:
+  Bench(const sys::Cli &cli, printer::Printer &printer)
+    : m_cli(cli), m_printer(printer) {
+    const auto iterations = cli.get_option("iterations");
+    if (!iterations.is_empty()) {
+      m_iterations = iterations.to_integer();
+    }
+#if defined HALAPI_IS_EMULATED
+    hal::Emulator::add(m_gpio_path, m_gpio);
+    hal::Emulator::add(m_spi_path, m_spi);
+    hal::Emulator::add(m_drive_path, m_drive);
+    hal::Emulator::add(m_byte_buffer_path, m_byte_buffer);
+    hal::Emulator::add(m_frame_buffer_path, m_frame_buffer);
+#endif
+  }
+
+  bool execute() {
+    m_printer.open_object("HalAPI_bench");
+    m_printer.key("iterations", var::NumberString(m_iterations));
+    bench_ioctl();
+    bench_read_write();
+    bench_transfer();
+    bench_drive();
+    bench_drain();
+    m_printer.close_object();
+    return m_is_success;
+  }
+
+private:
+  class Sample {
+    API_AF(Sample, u32, operation_count, 0);
+    API_AF(Sample, u32, byte_count, 0);
+    API_AF(Sample, int, error_number, 0);
+    API_AC(Sample, chrono::MicroTime, wall_time);
+    API_AC(Sample, chrono::MicroTime, device_time);
+    // wall time of each operation in microseconds
+    API_AC(Sample, var::Vector<u32>, latency);
+  };
+
+  static constexpr u32 buffer_sizes[] = {16, 64, 256, 1024, 4096};
+
+  const sys::Cli &m_cli;
+  printer::Printer &m_printer;
+  u32 m_iterations = 1000;
+  bool m_is_success = true;
+
+#if defined HALAPI_IS_EMULATED
+  hal::EmulatedGpio m_gpio;
+  hal::EmulatedSpi m_spi{20000000};
+  hal::EmulatedDrive m_drive{hal::EmulatedDrive::Construct()};
+  hal::EmulatedByteBuffer m_byte_buffer{4096};
+  hal::EmulatedFrameBuffer m_frame_buffer{64, 64};
+#endif
+
+  var::StringView path(var::StringView option, var::StringView value) const {
+    const auto result = m_cli.get_option(option);
+    return result.is_empty() ? value : result;
+  }
+
+  const var::StringView m_gpio_path = path("gpio", "/dev/pio0");
+  const var::StringView m_spi_path = path("spi", "/dev/spi0");
+  const var::StringView m_drive_path = path("drive", "/dev/drive0");
+  const var::StringView m_byte_buffer_path = path("fifo", "/dev/fifo");
+  const var::StringView m_frame_buffer_path = path("ffifo", "/dev/ffifo");
+
+  static chrono::MicroTime device_clock() {
+#if defined HALAPI_IS_EMULATED
+    return hal::Emulator::clock();
+#else
+    return chrono::MicroTime(0);
+#endif
+  }
+
+  template <typename Function>
+  Sample measure(u32 operation_count, u32 byte_count, const Function &function) {
+    api::ErrorScope error_scope;
+    const auto device_start = device_clock();
+    var::Vector<u32> latency;
+    latency.reserve(operation_count);
+    chrono::ClockTimer timer;
+    timer.start();
+    for (u32 i = 0; i < operation_count && api::ExecutionContext::is_success();
+         i++) {
+      const auto start = timer.micro_time();
+      function(i);
+      latency.push_back(u32((timer.micro_time() - start).microseconds()));
+    }
+    timer.stop();
+    return Sample()
+      .set_latency(latency)
+      .set_operation_count(operation_count)
+      .set_byte_count(byte_count)
+      .set_error_number(
+        api::ExecutionContext::is_error()
+          ? api::ExecutionContext::error().error_number()
+          : 0)
+      .set_wall_time(timer.micro_time())
+      .set_device_time(device_clock() - device_start);
+  }
+
+  static var::NumberString rate(u32 count, const chrono::MicroTime &time) {
+    if (time.microseconds() == 0) {
+      return var::NumberString(0);
+    }
+    return var::NumberString(u32(u64(count) * 1000000 / time.microseconds()));
+  }
+
+  void print(var::StringView name, const Sample &sample) {
+    m_printer.open_object(name)
+      .key("operations", var::NumberString(sample.operation_count()))
+      .key("bytes", var::NumberString(sample.byte_count()))
+      .key(
+        "wallMicroseconds",
+        var::NumberString(sample.wall_time().microseconds()))
+      .key(
+        "wallOperationsPerSecond",
+        rate(sample.operation_count(), sample.wall_time()))
+      .key("wallBytesPerSecond", rate(sample.byte_count(), sample.wall_time()));
+    print_latency(sample.latency());
+#if defined HALAPI_IS_EMULATED
+    m_printer
+      .key(
+        "deviceMicroseconds",
+        var::NumberString(sample.device_time().microseconds()))
+      .key(
+        "deviceBytesPerSecond",
+        rate(sample.byte_count(), sample.device_time()));
+#endif
+    if (sample.error_number()) {
+      m_is_success = false;
+      m_printer.key("error", var::NumberString(sample.error_number()));
+    }
+    m_printer.close_object();
+  }
+
+  // tail latency is what a real-time consumer of the driver sees
+  void print_latency(const var::Vector<u32> &latency) {
+    if (latency.count() == 0) {
+      return;
+    }
+    var::Vector<u32> sorted = latency;
+    std::sort(sorted.begin(), sorted.end());
+    const auto percentile = [&](u32 value) {
+      return var::NumberString(sorted.at((sorted.count() - 1) * value / 100));
+    };
+
+    hal::DeviceStatistics::Histogram histogram;
+    histogram.fill(0);
+    for (const auto value : latency) {
+      histogram.at(hal::DeviceStatistics::bucket(chrono::MicroTime(value)))++;
+    }
+
+    m_printer.open_object("latencyMicroseconds")
+      .key("p50", percentile(50))
+      .key("p99", percentile(99))
+      .key("max", var::NumberString(sorted.back()));
+    m_printer.open_object("histogram");
+    for (size_t i = 0; i < histogram.count(); i++) {
+      if (histogram.at(i)) {
+        const auto is_last = i == histogram.count() - 1;
+        m_printer.key(
+          var::NumberString(
+            1UL << (is_last ? i : i + 1),
+            is_last ? ">=%lu" : "<%lu"),
+          var::NumberString(histogram.at(i)));
+      }
+    }
+    m_printer.close_object().close_object();
+  }
+
+  void bench_ioctl() {
+    api::ErrorScope error_scope;
+    hal::Gpio gpio(m_gpio_path);
+    print("ioctlDispatch", measure(m_iterations, 0, [&](u32) {
+            (void)gpio.get_value();
+          }));
+  }
+
+  void bench_read_write() {
+    api::ErrorScope error_scope;
+    hal::Drive drive(m_drive_path);
+    const auto size = drive.get_info().size();
+    if (size == 0) {
+      m_printer.key("readWrite", "unavailable");
+      return;
+    }
+    m_printer.open_object("readWrite");
+    for (const auto buffer_size : buffer_sizes) {
+      var::Data buffer(buffer_size);
+      const u32 span = size - size % buffer_size;
+      const auto location = [&](u32 i) { return (i * buffer_size) % span; };
+      m_printer.open_object(var::NumberString(buffer_size));
+      print(
+        "write",
+        measure(m_iterations, m_iterations * buffer_size, [&](u32 i) {
+          drive.seek(location(i)).write(buffer);
+        }));
+      print(
+        "read",
+        measure(m_iterations, m_iterations * buffer_size, [&](u32 i) {
+          drive.seek(location(i)).read(buffer);
+        }));
+      m_printer.close_object();
+    }
+    m_printer.close_object();
+  }
+
+  template <typename Function>
+  void bench_transfer_sizes(var::StringView name, const Function &function) {
+    m_printer.open_object(name);
+    for (const auto buffer_size : buffer_sizes) {
+      var::Data source(buffer_size);
+      var::Data destination(buffer_size);
+      print(
+        var::NumberString(buffer_size),
+        measure(m_iterations, m_iterations * buffer_size, [&](u32) {
+          function(var::View(source), var::View(destination));
+        }));
+    }
+    m_printer.close_object();
+  }
+
+  void bench_transfer() {
+    api::ErrorScope error_scope;
+    hal::Spi spi(m_spi_path);
+#if defined __link && !defined HALAPI_IS_EMULATED
+    // the link driver has no aio, so there is no full duplex transfer
+    m_printer.key("transfer", "unavailable");
+#else
+    m_printer.open_object("transfer");
+#if defined __link
+    // the emulated driver runs a full duplex transaction in one ioctl
+    bench_transfer_sizes(
+      "execute",
+      [&](var::View source, var::View destination) {
+        spi.execute(hal::Spi::Transaction().transfer(source, destination));
+      });
+#else
+    using Completion = hal::Spi::Completion;
+    for (const auto completion : {Completion::poll, Completion::suspend}) {
+      bench_transfer_sizes(
+        completion == Completion::poll ? "poll" : "suspend",
+        [&](var::View source, var::View destination) {
+          spi.transfer(hal::Spi::Transfer()
+                         .set_source(source)
+                         .set_destination(destination)
+                         .set_completion(completion));
+        });
+    }
+#endif
+    m_printer.close_object();
+#endif
+  }
+
+  void bench_drive() {
+    api::ErrorScope error_scope;
+    hal::Drive drive(m_drive_path);
+    const auto info = drive.get_info();
+    if (!info.is_valid()) {
+      m_printer.key("drive", "unavailable");
+      return;
+    }
+    const u32 block_size = info.erase_block_size();
+    const u32 block_count
+      = std::min<u32>(m_iterations, info.size() / block_size);
+    var::Data page(info.page_program_size());
+
+    m_printer.open_object("drive");
+    print(
+      "erase",
+      measure(block_count, block_count * block_size, [&](u32 i) {
+        drive.erase_blocks(i * block_size, (i + 1) * block_size);
+      }));
+    const u32 page_count
+      = std::min<u32>(m_iterations, info.size() / page.size());
+    print(
+      "program",
+      measure(page_count, page_count * page.size(), [&](u32 i) {
+        drive.seek(i * page.size()).write(page);
+      }));
+    m_printer.close_object();
+  }
+
+  // fills the buffer, then times draining it with reads of read_size
+  template <class Device>
+  Sample drain(const Device &device, u32 capacity, u32 read_size) {
+    var::Data buffer(read_size);
+    var::Data fill(capacity);
+    const u32 reads_per_round = capacity / read_size;
+    const u32 rounds = (m_iterations + reads_per_round - 1) / reads_per_round;
+
+    Sample result;
+    var::Vector<u32> latency;
+    for (u32 round = 0; round < rounds; round++) {
+      device.write(fill);
+      const auto sample = measure(reads_per_round, capacity, [&](u32) {
+        device.read(buffer);
+      });
+      for (const auto value : sample.latency()) {
+        latency.push_back(value);
+      }
+      result.set_operation_count(result.operation_count() + reads_per_round)
+        .set_byte_count(result.byte_count() + capacity)
+        .set_wall_time(result.wall_time() + sample.wall_time())
+        .set_device_time(result.device_time() + sample.device_time());
+      if (sample.error_number()) {
+        return result.set_latency(latency).set_error_number(
+          sample.error_number());
+      }
+    }
+    return result.set_latency(latency);
+  }
+
+  void bench_drain() {
+    api::ErrorScope error_scope;
+    m_printer.open_object("drain");
+    {
+      hal::ByteBuffer byte_buffer(m_byte_buffer_path);
+      const u32 capacity = byte_buffer.get_info().size();
+      m_printer.open_object("ByteBuffer");
+      for (const auto buffer_size : buffer_sizes) {
+        if (buffer_size <= capacity) {
+          print(
+            var::NumberString(buffer_size),
+            drain(byte_buffer, capacity - capacity % buffer_size, buffer_size));
+        }
+      }
+      m_printer.close_object();
+    }
+    {
+      hal::FrameBuffer frame_buffer(m_frame_buffer_path);
+      const auto info = frame_buffer.get_info();
+      m_printer.open_object("FrameBuffer");
+      for (u32 frames = 1; frames <= info.frame_count(); frames *= 4) {
+        print(
+          var::NumberString(frames),
+          drain(frame_buffer, info.size(), frames * info.frame_size()));
+      }
+      m_printer.close_object();
+    }
+    m_printer.close_object();
+  }
+};
@@ -0,0 +1,24 @@
+#include <signal.h>
+
+#include "Bench.hpp"
+
+#define VERSION "0.1"
+#include "sys/Cli.hpp"
+
+void segfault(int a) { API_ASSERT(false); }
+
+int main(int argc, char *argv[]) {
+  sys::Cli cli(argc, argv);
+
+#if defined __link
+  signal(11, segfault);
+#endif
+
+  printer::JsonPrinter printer;
+
+  const bool is_success = Bench(cli, printer).execute();
+
+  exit(is_success == false);
+
+  return 0;
+}
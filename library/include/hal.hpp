@@ -6,19 +6,41 @@
 namespace hal {}
 
 #include "hal/Adc.hpp"
+#include "hal/AioRing.hpp"
+#include "hal/AttributeCache.hpp"
+#include "hal/BufferMap.hpp"
 #include "hal/ByteBuffer.hpp"
+#include "hal/ByteBufferArray.hpp"
+#include "hal/ByteBufferRing.hpp"
+#include "hal/DeviceBatch.hpp"
+#include "hal/DeviceEventQueue.hpp"
+#include "hal/DeviceExecutor.hpp"
+#include "hal/DeviceSelector.hpp"
+#include "hal/DeviceSignalCoalescer.hpp"
 #include "hal/Drive.hpp"
 #include "hal/Flash.hpp"
 #include "hal/FrameBuffer.hpp"
+#include "hal/FrameBufferReader.hpp"
+#include "hal/FramePool.hpp"
 #include "hal/FrameStream.hpp"
+#include "hal/FrameStreamGroup.hpp"
+#include "hal/FrameStreamMonitor.hpp"
+#include "hal/FrameStreamPipeline.hpp"
 #include "hal/Gpio.hpp"
 #include "hal/I2C.hpp"
 #include "hal/Pin.hpp"
 #include "hal/Pwm.hpp"
+#include "hal/SignalWait.hpp"
 #include "hal/Spi.hpp"
+#include "hal/SpiBus.hpp"
 #include "hal/Timer.hpp"
+#include "hal/TimestampedFrameReader.hpp"
 #include "hal/Uart.hpp"
 
+#if defined HALAPI_IS_EMULATED
+#include "hal/EmulatedDevices.hpp"
+#endif
+
 using namespace hal;
 
 #endif /* HALAPI_HAL_HPP_ */
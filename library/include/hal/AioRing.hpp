@@ -0,0 +1,229 @@
+// Copyright 2020-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#ifndef HALAPI_HAL_AIO_RING_HPP_
+#define HALAPI_HAL_AIO_RING_HPP_
+
+#if !defined __link
+
+#include <chrono/ClockTimer.hpp>
+#include <var/Array.hpp>
+
+#include "Device.hpp"
+
+namespace hal {
+
+/*! \details Keeps `Count` asynchronous reads of `BufferSize` bytes in flight
+ * against a device so that continuous capture does not drop data while the
+ * consumer is busy. Completed buffers are handed out in the order they were
+ * submitted and are re-armed with `release()`.
+ *
+ * ```cpp
+ * AioRing<3, 512> ring;
+ * Adc adc("/dev/adc0");
+ * ring.start(adc);
+ * while (is_running) {
+ *   const auto samples = ring.wait();
+ *   process(samples);
+ *   ring.release();
+ * }
+ * ring.stop();
+ * ```
+ *
+ * Drivers that only accept one pending request per channel report `EBUSY`
+ * for the extra requests; those buffers are armed as soon as the driver
+ * has finished the previous one.
+ */
+template <size_t Count, size_t BufferSize>
+class AioRing : public api::ExecutionContext {
+  static_assert(Count >= 2, "AioRing needs at least two buffers");
+
+public:
+  using Buffer = var::Array<u8, BufferSize>;
+
+  AioRing() = default;
+  AioRing(const AioRing &) = delete;
+  AioRing &operator=(const AioRing &) = delete;
+
+  // waits as long as the driver needs; the aiocbs and buffers go with it
+  ~AioRing() {
+    api::ErrorScope error_scope;
+    drain(chrono::MicroTime());
+  }
+
+  template <class Derived>
+  AioRing &start(const DeviceAccess<Derived> &device) {
+    return start(device.file());
+  }
+
+  AioRing &start(const DeviceObject::DeviceFile &file) {
+    API_RETURN_VALUE_IF_ERROR(*this);
+    // the aiocbs are reused, so the driver must be done with all of them
+    drain(chrono::MicroTime());
+    API_RETURN_VALUE_IF_ERROR(*this);
+    m_file = &file;
+    m_head = 0;
+    m_next = 0;
+    for (auto &state : m_state) {
+      state = State::idle;
+    }
+    arm_idle();
+    return *this;
+  }
+
+  /*! \details Waits for the oldest request to complete and returns
+   * the bytes that were read. An empty view is returned if the
+   * timeout (zero waits forever) expires or an error occurs.
+   *
+   */
+  var::View wait(const chrono::MicroTime &timeout = chrono::MicroTime()) {
+    API_RETURN_VALUE_IF_ERROR(var::View());
+    if (m_file == nullptr) {
+      return var::View();
+    }
+
+    if (m_state.at(m_head) == State::idle) {
+      // the driver refused this request earlier
+      arm_idle();
+      API_RETURN_VALUE_IF_ERROR(var::View());
+      if (m_state.at(m_head) == State::idle) {
+        return var::View();
+      }
+    }
+
+    if (m_state.at(m_head) == State::pending) {
+      auto &aio = m_aio.at(m_head);
+      if (!DeviceObject::suspend_implementation(aio, timeout)) {
+        return var::View();
+      }
+      API_RETURN_VALUE_IF_ERROR(var::View());
+      m_result.at(m_head) = DeviceObject::return_value_implementation(aio);
+      m_state.at(m_head) = State::ready;
+      // keep the driver busy while the consumer handles this buffer
+      arm_idle();
+    }
+
+    const auto result = m_result.at(m_head);
+    if (result < 0) {
+      API_RETURN_VALUE_ASSIGN_ERROR(var::View(), "aio read failed", EIO);
+    }
+    return var::View(m_buffer.at(m_head)).truncate(result);
+  }
+
+  AioRing &release() {
+    if (m_file == nullptr || m_state.at(m_head) != State::ready) {
+      return *this;
+    }
+    m_state.at(m_head) = State::idle;
+    m_head = (m_head + 1) % Count;
+    arm_idle();
+    return *this;
+  }
+
+  /*! \details Cancels the reads and waits up to `timeout` (zero waits as
+   * long as it takes) for the driver to give them back. If a request is
+   * still busy when the time is up, EBUSY is reported and the ring keeps
+   * running with that request pending; call stop() again before the ring
+   * or the device goes away.
+   *
+   */
+  AioRing &stop(const chrono::MicroTime &timeout = chrono::MicroTime(100000)) {
+    drain(timeout);
+    return *this;
+  }
+
+  API_NO_DISCARD bool is_running() const { return m_file != nullptr; }
+
+  API_NO_DISCARD size_t pending_count() const {
+    size_t result = 0;
+    for (const auto state : m_state) {
+      if (state == State::pending) {
+        result++;
+      }
+    }
+    return result;
+  }
+
+  static constexpr size_t count() { return Count; }
+  static constexpr size_t buffer_size() { return BufferSize; }
+
+private:
+  enum class State { idle, pending, ready };
+
+  const DeviceObject::DeviceFile *m_file = nullptr;
+  size_t m_head = 0;
+  size_t m_next = 0;
+  var::Array<State, Count> m_state;
+  var::Array<int, Count> m_result;
+  var::Array<fs::Aio, Count> m_aio;
+  var::Array<Buffer, Count> m_buffer;
+
+  bool drain(const chrono::MicroTime &timeout) {
+    if (m_file == nullptr) {
+      return true;
+    }
+    {
+      // the cancel must be issued even if the context is already in error
+      api::ErrorScope error_scope;
+      DeviceObject::cancel_read_implementation(*m_file);
+    }
+
+    chrono::ClockTimer timer;
+    timer.start();
+    bool is_drained = true;
+    for (size_t i = 0; i < Count; i++) {
+      // the driver must be done with every aiocb before the ring goes away
+      while (m_state.at(i) == State::pending && m_aio.at(i).is_busy()) {
+        if (timeout != chrono::MicroTime() && timer.micro_time() >= timeout) {
+          break;
+        }
+        chrono::wait(chrono::MicroTime(200));
+      }
+      if (m_state.at(i) == State::pending) {
+        if (m_aio.at(i).is_busy()) {
+          // still owned by the driver
+          is_drained = false;
+          continue;
+        }
+        DeviceObject::return_value_implementation(m_aio.at(i));
+      }
+      m_state.at(i) = State::idle;
+    }
+
+    if (!is_drained) {
+      API_RETURN_VALUE_ASSIGN_ERROR(false, "aio busy after cancel", EBUSY);
+    }
+    m_file = nullptr;
+    return true;
+  }
+
+  void arm_idle() {
+    while (m_state.at(m_next) == State::idle) {
+      auto &aio = m_aio.at(m_next);
+      aio.set_buffer(var::View(m_buffer.at(m_next)));
+
+      int error_number = 0;
+      {
+        api::ErrorScope error_scope;
+        DeviceObject::read_implementation(*m_file, aio);
+        error_number = is_error() ? error().error_number() : 0;
+      }
+
+      if (error_number == EBUSY) {
+        return;
+      }
+
+      if (error_number != 0) {
+        API_RETURN_ASSIGN_ERROR("failed to arm aio read", error_number);
+      }
+
+      m_state.at(m_next) = State::pending;
+      m_next = (m_next + 1) % Count;
+    }
+  }
+};
+
+} // namespace hal
+
+#endif
+
+#endif // HALAPI_HAL_AIO_RING_HPP_
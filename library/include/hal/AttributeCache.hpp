@@ -0,0 +1,61 @@
+// Copyright 2020-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#ifndef HALAPI_HAL_ATTRIBUTE_CACHE_HPP_
+#define HALAPI_HAL_ATTRIBUTE_CACHE_HPP_
+
+#include <var/Array.hpp>
+#include <var/StringView.hpp>
+
+namespace hal {
+
+/*! \details Remembers the last attributes applied to each peripheral
+ * so that `set_attributes()` can skip the ioctl when nothing changed.
+ * Entries are keyed by a hash of the path the device was opened with, so
+ * every handle on the same device shares one entry and a write through
+ * any of them replaces what the others compare against. Attributes are
+ * compared byte for byte; the `Attributes` classes zero their structs so
+ * padding never differs.
+ *
+ * Only `set_attributes()` goes through the cache. Attributes written with
+ * a plain `ioctl()`, a reset, another process or closing the file bypass
+ * it; call `invalidate()` afterwards.
+ *
+ */
+class AttributeCache {
+public:
+  static constexpr size_t entry_count = 8;
+  static constexpr size_t attributes_size = 96;
+
+  // identifies a device by its path; zero is never returned
+  static u32 key(var::StringView path);
+
+  API_NO_DISCARD bool
+  is_current(u32 key, int request, var::View attributes) const;
+
+  AttributeCache &update(u32 key, int request, var::View attributes);
+
+  AttributeCache &invalidate(u32 key);
+  AttributeCache &invalidate();
+
+  API_NO_DISCARD u32 hit_count() const { return m_hit_count; }
+  API_NO_DISCARD u32 miss_count() const { return m_miss_count; }
+
+private:
+  struct Entry {
+    u32 key = 0;
+    int request = 0;
+    size_t size = 0;
+    var::Array<u8, attributes_size> attributes;
+  };
+
+  var::Array<Entry, entry_count> m_entries;
+  size_t m_next_eviction = 0;
+  mutable u32 m_hit_count = 0;
+  mutable u32 m_miss_count = 0;
+
+  API_NO_DISCARD const Entry *find(u32 key, int request) const;
+};
+
+} // namespace hal
+
+#endif // HALAPI_HAL_ATTRIBUTE_CACHE_HPP_
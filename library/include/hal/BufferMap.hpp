@@ -0,0 +1,102 @@
+// Copyright 2020-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#ifndef HALAPI_HAL_BUFFER_MAP_HPP_
+#define HALAPI_HAL_BUFFER_MAP_HPP_
+
+#include <var/Data.hpp>
+
+#include "Device.hpp"
+
+namespace hal {
+
+/*! \details
+ *
+ * In-place access to the data waiting in a ByteBuffer or FrameBuffer.
+ * `acquire()` returns the ready bytes as at most two views (the second is
+ * only used when the data wraps) and `release()` advances the tail once the
+ * caller is done with them.
+ *
+ * The Stratify OS devfs has no mmap, so a device opened by path is read
+ * with a single read into a local buffer of `fallback_size` bytes (a whole
+ * number of frames for a FrameBuffer) and the views are served from there.
+ * A driver that lives in the same process can implement Mapping instead
+ * and hand out its ring with no copy at all. Only the HAL_API_IS_EMULATED
+ * fifo drivers do, so the zero-copy path is emulator-only: on hardware
+ * (and over link) every acquire() is a read and a copy, as before. The
+ * consumer code is the same either way.
+ *
+ * A mapped view points at the driver's ring, so a producer that is allowed
+ * to overwrite unread data could change it before `release()`. `acquire()`
+ * fails with EINVAL unless the mapping is in writeblock mode.
+ *
+ * ```cpp
+ * BufferMap map(frame_buffer, frame_size * 8);
+ * const auto region = map.acquire();
+ * parse(region.first());
+ * parse(region.second());
+ * map.release(region.size());
+ * ```
+ *
+ */
+class BufferMap : public api::ExecutionContext {
+public:
+  class Region {
+  public:
+    Region() = default;
+    Region(var::View first, var::View second)
+      : m_first(first), m_second(second) {}
+
+    API_NO_DISCARD const var::View &first() const { return m_first; }
+    API_NO_DISCARD const var::View &second() const { return m_second; }
+    API_NO_DISCARD size_t size() const {
+      return m_first.size() + m_second.size();
+    }
+    API_NO_DISCARD bool is_empty() const { return size() == 0; }
+
+  private:
+    var::View m_first;
+    var::View m_second;
+  };
+
+  // implemented by in-process drivers that can share their ring
+  class Mapping {
+  public:
+    virtual ~Mapping() = default;
+    // the ready data, oldest first
+    virtual Region map() = 0;
+    // returns -1 with errno set if size is not a whole number of frames
+    virtual int consume(size_t size) = 0;
+    // true if the producer waits instead of overwriting unread data
+    API_NO_DISCARD virtual bool is_writeblock() const = 0;
+  };
+
+  template <class Derived>
+  BufferMap(const DeviceAccess<Derived> &device, size_t fallback_size)
+    : BufferMap(device.file(), fallback_size) {}
+
+  BufferMap(const DeviceObject::DeviceFile &file, size_t fallback_size);
+  explicit BufferMap(Mapping &mapping) : m_mapping(&mapping) {}
+
+  BufferMap(const BufferMap &) = delete;
+  BufferMap &operator=(const BufferMap &) = delete;
+
+  // views stay valid until release()
+  Region acquire();
+  BufferMap &release(size_t size);
+
+  API_NO_DISCARD bool is_mapped() const { return m_mapping != nullptr; }
+
+private:
+  const DeviceObject::DeviceFile *m_file = nullptr;
+  Mapping *m_mapping = nullptr;
+  var::Data m_fallback;
+  size_t m_fallback_offset = 0;
+  size_t m_fallback_count = 0;
+
+  Region acquire_mapped();
+  Region acquire_fallback();
+};
+
+} // namespace hal
+
+#endif // HALAPI_HAL_BUFFER_MAP_HPP_
@@ -70,6 +70,14 @@ public:
       m_attributes.o_flags |= FIFO_FLAG_SET_WRITEBLOCK;
       return *this;
     }
+    Attributes &set_notify_read() {
+      m_attributes.o_flags |= FIFO_FLAG_NOTIFY_READ;
+      return *this;
+    }
+    Attributes &set_notify_write() {
+      m_attributes.o_flags |= FIFO_FLAG_NOTIFY_WRITE;
+      return *this;
+    }
 
     API_NO_DISCARD Flags flags() const {
       return static_cast<Flags>(m_attributes.o_flags);
@@ -85,6 +93,19 @@ public:
     fifo_attr_t m_attributes{};
   };
 
+#if !defined __link
+  class Watermark {
+    API_AF(Watermark, u32, size, 1);
+    // zero waits until size bytes are ready
+    API_AC(Watermark, chrono::MicroTime, timeout);
+    API_AF(
+      Watermark,
+      thread::Signal::Number,
+      signal_number,
+      thread::Signal::Number::user1);
+  };
+#endif
+
   ByteBuffer() = default;
   ByteBuffer(
     const var::StringView device,
@@ -106,6 +127,23 @@ public:
     ioctl(I_FIFO_GETINFO, &info);
     return Info(info);
   }
+
+#if !defined __link
+  /*! \details Sleeps until at least `size` bytes are ready or the
+   * timeout expires and returns the fifo state at that moment. The
+   * calling thread is woken by a DeviceSignal on each data-ready event,
+   * so the fifo must have notifications enabled (see
+   * Attributes::set_notify_read()). Any action already set on the fifo
+   * is replaced.
+   *
+   * The fifo driver has no threshold setting, so the watermark is checked
+   * with get_info() after every wake-up: a driver that notifies per byte
+   * still wakes the thread per byte. This replaces a sleep-and-poll loop
+   * with one call; it does not reduce the wake-up rate.
+   *
+   */
+  Info wait_ready(const Watermark &options) const;
+#endif
 };
 
 } // namespace hal
@@ -0,0 +1,111 @@
+// Copyright 2020-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#ifndef HALAPI_HAL_BYTE_BUFFER_ARRAY_HPP_
+#define HALAPI_HAL_BYTE_BUFFER_ARRAY_HPP_
+
+#include <sos/dev/cfifo.h>
+
+#include <var/Array.hpp>
+
+#include "ByteBuffer.hpp"
+
+namespace hal {
+
+/*! \details
+ *
+ * Access to the sos cfifo driver: an array of byte fifos behind one
+ * device. The channel is selected by the file location, so
+ * `seek(channel)` before `read()` or `write()`.
+ *
+ */
+class ByteBufferArray : public DeviceAccess<ByteBufferArray> {
+public:
+  // channels beyond this are not covered by the driver's ready mask
+  static constexpr u32 maximum_channel_count = 32;
+
+  class Info {
+  public:
+    Info() = default;
+    explicit Info(const cfifo_info_t &info) : m_info(info) {}
+
+    API_NO_DISCARD bool is_valid() const { return m_info.count > 0; }
+    API_NO_DISCARD u32 count() const { return m_info.count; }
+    API_NO_DISCARD u32 size() const { return m_info.size; }
+    API_NO_DISCARD u32 o_ready() const { return m_info.o_ready; }
+    API_NO_DISCARD bool is_ready(u32 channel) const {
+      return channel >= maximum_channel_count
+             || (m_info.o_ready & (1UL << channel));
+    }
+
+  private:
+    cfifo_info_t m_info{};
+  };
+
+  // the state of every channel at one moment
+  class ChannelInfo {
+  public:
+    API_NO_DISCARD bool is_valid() const { return m_info.is_valid(); }
+    API_NO_DISCARD u32 count() const { return m_info.count(); }
+    API_NO_DISCARD const Info &info() const { return m_info; }
+
+    API_NO_DISCARD ByteBuffer::Info at(u32 channel) const {
+      if (channel >= count() || channel >= maximum_channel_count) {
+        return ByteBuffer::Info();
+      }
+      fifo_info_t result = {};
+      result.size = m_info.size();
+      result.size_ready = m_size_ready.at(channel);
+      result.overflow = (m_o_overflow & (1UL << channel)) != 0;
+      return ByteBuffer::Info(result);
+    }
+
+  private:
+    friend class ByteBufferArray;
+    Info m_info;
+    var::Array<u32, maximum_channel_count> m_size_ready;
+    u32 m_o_overflow = 0;
+  };
+
+  ByteBufferArray() = default;
+  explicit ByteBufferArray(
+    const var::StringView device,
+    fs::OpenMode open_mode
+    = DEVICE_OPEN_MODE FSAPI_LINK_DECLARE_DRIVER_NULLPTR_LAST)
+    : DeviceAccess(device, open_mode FSAPI_LINK_INHERIT_DRIVER_LAST) {}
+
+  API_NO_DISCARD Info get_info() const;
+  API_NO_DISCARD ByteBuffer::Info get_info(u32 channel) const;
+
+  /*! \details Reads the driver's ready mask with one I_CFIFO_GETINFO and
+   * asks for the fifo info of the ready channels only; idle channels are
+   * reported empty without a request.
+   *
+   */
+  API_NO_DISCARD ChannelInfo get_channel_info() const;
+
+  API_NO_DISCARD int get_owner(u32 channel) const;
+  const ByteBufferArray &set_owner(u32 channel, int owner) const;
+
+  const ByteBufferArray &
+  set_attributes(u32 channel, const ByteBuffer::Attributes &attributes) const;
+  const ByteBufferArray &set_writeblock(u32 channel, bool value = true) const;
+
+  const ByteBufferArray &initialize(u32 channel) const {
+    return channel_request(I_CFIFO_FIFOINIT, channel);
+  }
+
+  const ByteBufferArray &flush(u32 channel) const {
+    return channel_request(I_CFIFO_FIFOFLUSH, channel);
+  }
+
+  const ByteBufferArray &finalize(u32 channel) const {
+    return channel_request(I_CFIFO_FIFOEXIT, channel);
+  }
+
+private:
+  const ByteBufferArray &channel_request(int request, u32 channel) const;
+};
+
+} // namespace hal
+
+#endif // HALAPI_HAL_BYTE_BUFFER_ARRAY_HPP_
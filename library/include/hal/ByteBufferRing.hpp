@@ -0,0 +1,144 @@
+// Copyright 2020-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#ifndef HALAPI_HAL_BYTE_BUFFER_RING_HPP_
+#define HALAPI_HAL_BYTE_BUFFER_RING_HPP_
+
+#include <algorithm>
+
+#include <var/Array.hpp>
+
+#include "ByteBuffer.hpp"
+
+namespace hal {
+
+/*! \details User-space ring that mirrors a ByteBuffer. `drain()` reads
+ * whatever the fifo holds straight into the free part of the ring without
+ * asking for `get_info()` first, so a batch usually costs one read. When
+ * that read fills the space up to the end of the ring, `get_info()` bounds
+ * the second read at the start of the ring, so it never blocks.
+ *
+ * ```cpp
+ * ByteBufferRing<1024> ring;
+ * ByteBuffer fifo("/dev/fifo", fs::OpenMode::read_only().set_non_blocking());
+ * ring.drain(fifo);
+ * const auto peek = ring.peek();
+ * log.write(peek.first()).write(peek.second());
+ * ring.commit(peek.size());
+ * ```
+ *
+ * With a blocking device, the first read in `drain()` waits until at least
+ * one byte is available. With a non-blocking device, an empty fifo is not
+ * an error.
+ */
+template <size_t Size> class ByteBufferRing : public api::ExecutionContext {
+  static_assert(
+    Size >= 2 && (Size & (Size - 1)) == 0,
+    "ByteBufferRing size must be a power of two");
+
+public:
+  // the ready bytes in order; second() is empty unless they wrap
+  class Peek {
+  public:
+    Peek() = default;
+    Peek(var::View first, var::View second)
+      : m_first(first), m_second(second) {}
+
+    API_NO_DISCARD const var::View &first() const { return m_first; }
+    API_NO_DISCARD const var::View &second() const { return m_second; }
+    API_NO_DISCARD size_t size() const {
+      return m_first.size() + m_second.size();
+    }
+    API_NO_DISCARD bool is_empty() const { return size() == 0; }
+
+  private:
+    var::View m_first;
+    var::View m_second;
+  };
+
+  ByteBufferRing() = default;
+
+  // returns the number of bytes added to the ring
+  size_t drain(const ByteBuffer &device) {
+    API_RETURN_VALUE_IF_ERROR(0);
+    size_t result = 0;
+    while (free_count()) {
+      const auto offset = m_head & (Size - 1);
+      auto size = std::min(Size - offset, free_count());
+      if (result) {
+        // only read what is already there
+        const auto info = device.get_info();
+        API_RETURN_VALUE_IF_ERROR(result);
+        size = std::min(size, size_t(info.size_ready()));
+        if (size == 0) {
+          break;
+        }
+      }
+      const auto count
+        = read(device, var::View(m_buffer.data() + offset, size));
+      if (count <= 0) {
+        break;
+      }
+      m_head += count;
+      result += count;
+      if (size_t(count) < size) {
+        // the fifo is empty
+        break;
+      }
+    }
+    return result;
+  }
+
+  API_NO_DISCARD Peek peek() const {
+    const auto offset = m_tail & (Size - 1);
+    const auto first = std::min(Size - offset, count());
+    return Peek(
+      var::View(m_buffer.data() + offset, first),
+      var::View(m_buffer.data(), count() - first));
+  }
+
+  // releases size bytes of what peek() returned
+  ByteBufferRing &commit(size_t size) {
+    m_tail += u32(std::min(size, count()));
+    return *this;
+  }
+
+  ByteBufferRing &clear() {
+    m_tail = m_head;
+    return *this;
+  }
+
+  API_NO_DISCARD size_t count() const { return m_head - m_tail; }
+  API_NO_DISCARD size_t free_count() const { return Size - count(); }
+  API_NO_DISCARD bool is_empty() const { return count() == 0; }
+  API_NO_DISCARD bool is_full() const { return count() == Size; }
+  static constexpr size_t size() { return Size; }
+
+private:
+  // free running; the difference is the number of bytes ready
+  u32 m_head = 0;
+  u32 m_tail = 0;
+  var::Array<u8, Size> m_buffer;
+
+  int read(const ByteBuffer &device, var::View destination) {
+    int result = 0;
+    int error_number = 0;
+    {
+      api::ErrorScope error_scope;
+      result = device.file().read(destination).return_value();
+      error_number = is_error() ? error().error_number() : 0;
+    }
+
+    if (error_number == EAGAIN) {
+      return 0;
+    }
+
+    if (error_number != 0) {
+      API_RETURN_VALUE_ASSIGN_ERROR(-1, "failed to drain fifo", error_number);
+    }
+    return result;
+  }
+};
+
+} // namespace hal
+
+#endif // HALAPI_HAL_BYTE_BUFFER_RING_HPP_
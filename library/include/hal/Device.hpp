@@ -3,22 +3,110 @@
 #ifndef HALAPI_HAL_DEVICE_HPP_
 #define HALAPI_HAL_DEVICE_HPP_
 
+
 #include <sos/Link.hpp>
+#include <var/Array.hpp>
+#include <var/Vector.hpp>
 
+#include "AttributeCache.hpp"
 #include "DeviceSignal.hpp"
+#include "DeviceStatistics.hpp"
+#include "chrono/ClockTimer.hpp"
+#include "chrono/MicroTime.hpp"
 #include "fs/Aio.hpp"
 #include "fs/File.hpp"
 
+#if !defined __link && defined __cpp_impl_coroutine
+#include <coroutine>
+#endif
+
+#if defined HALAPI_IS_EMULATED
+#include "Emulator.hpp"
+#endif
+
 namespace hal {
 
-class DeviceObject : public api::ExecutionContext {
-public:
+#if !defined __link
+template <size_t Count, size_t BufferSize> class AioRing;
+class DeviceExecutor;
+#endif
+
 #if defined __link
 #define DEVICE_OPEN_MODE (fs::OpenMode::read_write().set_non_blocking())
-  using DeviceFile = sos::Link::File;
 #else
 #define DEVICE_OPEN_MODE fs::OpenMode::read_write()
-  using DeviceFile = fs::File;
+#endif
+
+// times every driver call while a DeviceStatistics object is attached;
+// devices only use it in HAL_API_IS_INSTRUMENTED builds
+template <class FileClass> class InstrumentedFile : public FileClass {
+public:
+  InstrumentedFile() = default;
+  InstrumentedFile(
+    const var::StringView path,
+    fs::OpenMode open_mode
+    = DEVICE_OPEN_MODE FSAPI_LINK_DECLARE_DRIVER_NULLPTR_LAST)
+    : FileClass(path, open_mode FSAPI_LINK_INHERIT_DRIVER_LAST) {}
+
+  InstrumentedFile &set_statistics(DeviceStatistics *value) {
+    m_statistics = value;
+    return *this;
+  }
+
+  API_NO_DISCARD DeviceStatistics *statistics() const { return m_statistics; }
+
+protected:
+  int interface_read(void *buf, int nbyte) const override {
+    return record(DeviceStatistics::Operation::read, 0, [&]() {
+      return FileClass::interface_read(buf, nbyte);
+    });
+  }
+
+  int interface_write(const void *buf, int nbyte) const override {
+    return record(DeviceStatistics::Operation::write, 0, [&]() {
+      return FileClass::interface_write(buf, nbyte);
+    });
+  }
+
+  int interface_ioctl(int request, void *argument) const override {
+    return record(DeviceStatistics::Operation::ioctl, request, [&]() {
+      return FileClass::interface_ioctl(request, argument);
+    });
+  }
+
+private:
+  DeviceStatistics *m_statistics = nullptr;
+
+  template <typename Function>
+  int record(
+    DeviceStatistics::Operation operation,
+    int request,
+    const Function &function) const {
+    if (m_statistics == nullptr) {
+      return function();
+    }
+    chrono::ClockTimer timer;
+    timer.start();
+    const auto result = function();
+    m_statistics->record(operation, request, result, timer.micro_time());
+    return result;
+  }
+};
+
+class DeviceObject : public api::ExecutionContext {
+public:
+#if defined HALAPI_IS_EMULATED
+  using PlainFile = EmulatedFile;
+#elif defined __link
+  using PlainFile = sos::Link::File;
+#else
+  using PlainFile = fs::File;
+#endif
+
+#if defined HALAPI_IS_INSTRUMENTED
+  using DeviceFile = InstrumentedFile<PlainFile>;
+#else
+  using DeviceFile = PlainFile;
 #endif
 
   class Channel {
@@ -26,14 +114,116 @@ public:
     API_ACCESS_FUNDAMENTAL(Channel, u32, value, 0);
   };
 
+  // refers to views owned by the caller, nothing is copied; the views
+  // must outlive the span, so temporaries are not accepted
+  class ViewSpan {
+  public:
+    ViewSpan() = default;
+    ViewSpan(const var::View *views, size_t count)
+      : m_views(views), m_count(count) {}
+    template <size_t Size>
+    ViewSpan(const var::Array<var::View, Size> &views)
+      : m_views(&views.at(0)), m_count(Size) {
+      static_assert(Size > 0, "ViewSpan needs at least one view");
+    }
+    template <size_t Size>
+    ViewSpan(const var::Array<var::View, Size> &&views) = delete;
+    ViewSpan(const var::Vector<var::View> &views)
+      : m_views(views.count() ? &views.at(0) : nullptr),
+        m_count(views.count()) {}
+    ViewSpan(const var::Vector<var::View> &&views) = delete;
+
+    API_NO_DISCARD const var::View *begin() const { return m_views; }
+    API_NO_DISCARD const var::View *end() const { return m_views + m_count; }
+    API_NO_DISCARD size_t count() const { return m_count; }
+
+    API_NO_DISCARD size_t size() const {
+      size_t result = 0;
+      for (const auto &view : *this) {
+        result += view.size();
+      }
+      return result;
+    }
+
+  private:
+    const var::View *m_views = nullptr;
+    size_t m_count = 0;
+  };
+
 #if !defined __link
 
+  // full duplex transfers need aio, which only target builds have; the
+  // emulator does not provide it
+  enum class Completion { poll, suspend };
+
   class Transfer {
     API_AC(Transfer, var::View, source);
     API_AC(Transfer, var::View, destination);
+    API_AF(Transfer, Completion, completion, Completion::suspend);
+    // a zero timeout waits until the transfer completes
+    API_AC(Transfer, chrono::MicroTime, timeout);
+  };
+
+  // source and destination must have the same total size
+  class ScatterTransfer {
+    API_AC(ScatterTransfer, ViewSpan, source);
+    API_AC(ScatterTransfer, ViewSpan, destination);
+    API_AF(ScatterTransfer, Completion, completion, Completion::suspend);
+    // applies to the whole call; a zero timeout waits until it completes
+    API_AC(ScatterTransfer, chrono::MicroTime, timeout);
+  };
+
+#if defined __cpp_impl_coroutine
+  // returned by async_read(), async_write() and async_transfer(); co_await it
+  // inside a DeviceTask. The buffers must outlive the co_await expression.
+  class Awaitable : public api::ExecutionContext {
+  public:
+    enum class Type { read, write, transfer };
+
+    Awaitable(
+      const DeviceFile &file,
+      Type type,
+      var::View buffer,
+      var::View source = var::View())
+      : m_file(&file), m_type(type), m_source(source), m_aio(buffer) {}
+
+    Awaitable(const Awaitable &) = delete;
+    Awaitable &operator=(const Awaitable &) = delete;
+
+    API_NO_DISCARD bool await_ready() const noexcept { return false; }
+
+    // the promise of the awaiting coroutine names its executor
+    template <class Promise>
+    bool await_suspend(std::coroutine_handle<Promise> handle) {
+      return start(handle.promise().executor(), handle);
+    }
+
+    // bytes read or written, or -1 with the error in the context
+    int await_resume();
+
+  private:
+    const DeviceFile *m_file;
+    Type m_type;
+    var::View m_source;
+    fs::Aio m_aio;
+    // set when the request could not be submitted
+    int m_error_number = 0;
+
+    bool start(DeviceExecutor *executor, std::coroutine_handle<> handle);
   };
+#endif
+#endif
 
 protected:
+  static size_t
+  scatter_read_implementation(const DeviceFile &file, const ViewSpan &views);
+  static void
+  gather_write_implementation(const DeviceFile &file, const ViewSpan &views);
+
+#if !defined __link
+  template <size_t Count, size_t BufferSize> friend class AioRing;
+  friend class DeviceExecutor;
+
   static void set_interrupt_priority_implementation(
     const DeviceFile &file,
     int priority,
@@ -50,6 +240,23 @@ protected:
 
   static void
   transfer_implementation(const DeviceFile &file, const Transfer &options);
+  static void transfer_implementation(
+    const DeviceFile &file,
+    const ScatterTransfer &options);
+
+  // true once aio completes; false on timeout or error with aio in flight
+  static bool
+  poll_implementation(const fs::Aio &aio, const chrono::MicroTime &timeout);
+  static bool
+  suspend_implementation(fs::Aio &aio, const chrono::MicroTime &timeout);
+  // blocks until any of the count requests in list completes; the list is
+  // the caller's so the wait itself does not allocate
+  static void
+  suspend_implementation(const struct aiocb *const *list, size_t count);
+  static const struct aiocb *control_block_implementation(const fs::Aio &aio) {
+    return &aio.m_aio_var;
+  }
+  static int return_value_implementation(fs::Aio &aio);
 
   static void set_signal_action_implementation(
     const DeviceFile &file,
@@ -77,8 +284,8 @@ public:
                                  FSAPI_LINK_DECLARE_DRIVER_NULLPTR_LAST)
     : fs::FileMemberAccess<Derived, DeviceFile>(
       path,
-      open_mode FSAPI_LINK_INHERIT_DRIVER_LAST) {
-  }
+      open_mode FSAPI_LINK_INHERIT_DRIVER_LAST),
+      m_attribute_key(AttributeCache::key(path)) {}
 
   using FileBase::file;
   using FileBase::ioctl;
@@ -89,6 +296,55 @@ public:
   API_NO_DISCARD int fileno() const { return file().fileno(); }
   API_NO_DISCARD bool is_valid() const { return file().is_valid(); }
 
+#if defined HALAPI_IS_INSTRUMENTED
+  // pass nullptr to stop recording
+  Derived &set_statistics(DeviceStatistics *statistics) {
+    FileBase::file().set_statistics(statistics);
+    return static_cast<Derived &>(*this);
+  }
+
+  API_NO_DISCARD DeviceStatistics *statistics() const {
+    return file().statistics();
+  }
+#endif
+
+  // pass nullptr to always apply attributes; entries are keyed by the
+  // path this object was opened with
+  Derived &set_attribute_cache(AttributeCache *cache) {
+    m_attribute_cache = cache;
+    return static_cast<Derived &>(*this);
+  }
+
+  API_NO_DISCARD AttributeCache *attribute_cache() const {
+    return m_attribute_cache;
+  }
+
+  const Derived &invalidate_attribute_cache() const {
+    if (m_attribute_cache != nullptr) {
+      m_attribute_cache->invalidate(m_attribute_key);
+    }
+    return static_cast<const Derived &>(*this);
+  }
+
+  // scatter_read(), gather_write() and transfer(ScatterTransfer) save the
+  // copy into one contiguous buffer, not syscalls: each view is still its
+  // own driver call (there is no readv()/writev() on the device layer)
+
+  // returns the bytes read; less than views.size() if the device ran dry
+  size_t scatter_read(const ViewSpan &views) const {
+    return scatter_read_implementation(FileBase::file(), views);
+  }
+
+#define HALAPI_DEVICE_FUNCTION_GROUP(QUAL)                                     \
+  auto QUAL gather_write(const ViewSpan &views) QUAL {                         \
+    gather_write_implementation(FileBase::file(), views);                      \
+    return static_cast<Derived QUAL>(*this);                                   \
+  }
+  HALAPI_DEVICE_FUNCTION_GROUP(const &)
+  HALAPI_DEVICE_FUNCTION_GROUP(&)
+  HALAPI_DEVICE_FUNCTION_GROUP(&&)
+#undef HALAPI_DEVICE_FUNCTION_GROUP
+
 #if !defined __link
 #define HALAPI_DEVICE_FUNCTION_GROUP(QUAL)                                     \
   auto QUAL cancel(int channel, int o_events) QUAL {                           \
@@ -171,7 +427,67 @@ public:
   HALAPI_DEVICE_FUNCTION_GROUP(&)
   HALAPI_DEVICE_FUNCTION_GROUP(&&)
 #undef HALAPI_DEVICE_FUNCTION_GROUP
+
+#define HALAPI_DEVICE_FUNCTION_GROUP(QUAL)                                     \
+  auto QUAL transfer(const ScatterTransfer &options) QUAL {                    \
+    transfer_implementation(FileBase::file(), options);                        \
+    return static_cast<Derived QUAL>(*this);                                   \
+  }
+  HALAPI_DEVICE_FUNCTION_GROUP(const &)
+  HALAPI_DEVICE_FUNCTION_GROUP(&)
+  HALAPI_DEVICE_FUNCTION_GROUP(&&)
+#undef HALAPI_DEVICE_FUNCTION_GROUP
+
+#if defined __cpp_impl_coroutine
+  API_NO_DISCARD Awaitable async_read(var::View destination) const {
+    return Awaitable(file(), Awaitable::Type::read, destination);
+  }
+
+  API_NO_DISCARD Awaitable async_write(var::View source) const {
+    return Awaitable(file(), Awaitable::Type::write, source);
+  }
+
+  // the write is synchronous, as with transfer(); completion and timeout
+  // are ignored
+  API_NO_DISCARD Awaitable async_transfer(const Transfer &options) const {
+    return Awaitable(
+      file(),
+      Awaitable::Type::transfer,
+      options.destination(),
+      options.source());
+  }
 #endif
+#endif
+
+protected:
+  // skips the ioctl if the attached cache says nothing changed
+  template <typename Attributes>
+  const Derived &
+  apply_attributes(int request, const Attributes &attributes) const {
+    const auto view = var::View(attributes);
+    // a default constructed object has no path to key the cache with
+    const auto is_cached
+      = m_attribute_cache != nullptr && m_attribute_key != 0 && is_valid();
+    if (
+      is_cached
+      && m_attribute_cache->is_current(m_attribute_key, request, view)) {
+      return static_cast<const Derived &>(*this);
+    }
+
+    ioctl(request, (void *)&attributes);
+    if (is_cached) {
+      if (DeviceObject::is_success()) {
+        m_attribute_cache->update(m_attribute_key, request, view);
+      } else {
+        m_attribute_cache->invalidate(m_attribute_key);
+      }
+    }
+    return static_cast<const Derived &>(*this);
+  }
+
+private:
+  AttributeCache *m_attribute_cache = nullptr;
+  u32 m_attribute_key = 0;
 };
 
 class Device : public DeviceAccess<Device> {
@@ -0,0 +1,107 @@
+// Copyright 2020-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#ifndef HALAPI_HAL_DEVICE_BATCH_HPP_
+#define HALAPI_HAL_DEVICE_BATCH_HPP_
+
+#include <var/Vector.hpp>
+
+#include "Device.hpp"
+
+namespace hal {
+
+/*! \details
+ *
+ * Records ioctl, read and write operations and submits them against a
+ * device in one call, keeping a return value and errno per operation.
+ *
+ * Drivers have no vectored request, so every operation is still its own
+ * driver call (and its own round trip on link builds); the batch sequences
+ * them and collects the results. With set_coalesce(), adjacent reads (or
+ * writes) whose views lie back to back in memory go to the driver as one
+ * call and the byte count is shared out in order; nothing is copied, and
+ * views that are not contiguous are issued one at a time. Only use it on
+ * devices where one larger transfer means the same as several back to back
+ * ones.
+ *
+ */
+class DeviceBatch : public api::ExecutionContext {
+  API_AB(DeviceBatch, coalesce, false);
+
+public:
+  enum class Type { ioctl, read, write };
+  enum class IsStopOnError { no, yes };
+
+  class Operation {
+    API_AF(Operation, Type, type, Type::ioctl);
+    API_AF(Operation, int, request, 0);
+    API_AF(Operation, void *, argument, nullptr);
+    API_AC(Operation, var::View, view);
+    API_AF(Operation, int, return_value, 0);
+    API_AF(Operation, int, error_number, 0);
+    API_AB(Operation, submitted, false);
+
+  public:
+    API_NO_DISCARD bool is_success() const {
+      return is_submitted() && error_number() == 0;
+    }
+  };
+
+  DeviceBatch() = default;
+
+  DeviceBatch &ioctl(int request, void *argument = nullptr) {
+    m_operations.push_back(
+      Operation().set_type(Type::ioctl).set_request(request).set_argument(
+        argument));
+    return *this;
+  }
+
+  DeviceBatch &read(var::View view) {
+    m_operations.push_back(Operation().set_type(Type::read).set_view(view));
+    return *this;
+  }
+
+  DeviceBatch &write(var::View view) {
+    m_operations.push_back(Operation().set_type(Type::write).set_view(view));
+    return *this;
+  }
+
+  template <class Derived>
+  DeviceBatch &submit(
+    const DeviceAccess<Derived> &device,
+    IsStopOnError is_stop_on_error = IsStopOnError::yes) {
+    return submit(device.file(), is_stop_on_error);
+  }
+
+  // results from an earlier submit() are cleared first
+  DeviceBatch &submit(
+    const DeviceObject::DeviceFile &file,
+    IsStopOnError is_stop_on_error = IsStopOnError::yes);
+
+  DeviceBatch &clear() {
+    m_operations.clear();
+    return *this;
+  }
+
+  API_NO_DISCARD const var::Vector<Operation> &operations() const {
+    return m_operations;
+  }
+
+  API_NO_DISCARD size_t count() const { return m_operations.count(); }
+  API_NO_DISCARD size_t error_count() const;
+
+private:
+  var::Vector<Operation> m_operations;
+
+  // returns the number of operations run, stopping at the end of the run
+  size_t submit_run(const DeviceObject::DeviceFile &file, size_t offset);
+  void submit_one(const DeviceObject::DeviceFile &file, Operation &operation);
+};
+
+} // namespace hal
+
+namespace printer {
+Printer &operator<<(Printer &printer, const hal::DeviceBatch::Operation &a);
+Printer &operator<<(Printer &printer, const hal::DeviceBatch &a);
+} // namespace printer
+
+#endif // HALAPI_HAL_DEVICE_BATCH_HPP_
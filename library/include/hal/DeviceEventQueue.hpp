@@ -0,0 +1,310 @@
+// Copyright 2020-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#ifndef HALAPI_HAL_DEVICE_EVENT_QUEUE_HPP_
+#define HALAPI_HAL_DEVICE_EVENT_QUEUE_HPP_
+
+#if !defined __link
+
+#include <atomic>
+
+#include <sos/fs/devfs.h>
+
+#include <chrono/ClockTime.hpp>
+#include <thread/Thread.hpp>
+#include <var/Array.hpp>
+
+#include "SignalWait.hpp"
+
+namespace hal {
+
+/*! \details
+ *
+ * Runs driver events on a worker thread instead of in a signal handler.
+ * Each device added to the queue gets an I_MCU_SETACTION handler that
+ * pushes an Event into a lock-free ring (safe with nested interrupts). The
+ * worker thread is only signalled when the ring goes from empty to
+ * non-empty, and it hands events to the handler in batches of up to
+ * `BatchSize`. The handler runs in an ordinary thread and is free to block,
+ * allocate or take locks.
+ *
+ * ```cpp
+ * DeviceEventQueue<64> queue;
+ * queue.start(DeviceEventQueue<64>::Construct()
+ *               .set_handler(handle_events)
+ *               .set_context(&state));
+ * queue.add(
+ *   uart,
+ *   DeviceEventQueue<64>::CreateAction().set_o_events(
+ *     MCU_EVENT_FLAG_DATA_READY));
+ * ```
+ *
+ * The timestamp is taken when the worker dequeues a batch, because the
+ * system clock cannot be read from every interrupt. Events that arrive
+ * while the ring is full are counted by dropped_count().
+ *
+ */
+template <size_t Count, size_t BatchSize = 16>
+class DeviceEventQueue : public api::ExecutionContext {
+  static_assert(
+    Count >= 2 && (Count & (Count - 1)) == 0,
+    "DeviceEventQueue size must be a power of two");
+
+public:
+  static constexpr size_t maximum_source_count = 16;
+
+  class Event {
+  public:
+    // index returned by add()
+    API_AF(Event, u16, source, 0);
+    API_AF(Event, u8, channel, 0);
+    API_AF(Event, u32, o_events, 0);
+    API_AC(Event, chrono::ClockTime, timestamp);
+  };
+
+  using Handler = void (*)(void *context, const Event *events, size_t count);
+
+  class Construct {
+    API_AF(Construct, Handler, handler, nullptr);
+    API_AF(Construct, void *, context, nullptr);
+    API_AF(
+      Construct,
+      thread::Signal::Number,
+      signal_number,
+      thread::Signal::Number::user1);
+    API_AF(Construct, u32, stack_size, 2048);
+  };
+
+  class CreateAction {
+    API_AF(CreateAction, u32, o_events, 0);
+    API_AF(CreateAction, u8, channel, 0);
+    API_AF(CreateAction, u32, priority, 0);
+  };
+
+  DeviceEventQueue() {
+    for (u32 i = 0; i < Count; i++) {
+      m_slots.at(i).sequence = i;
+    }
+  }
+
+  DeviceEventQueue(const DeviceEventQueue &) = delete;
+  DeviceEventQueue &operator=(const DeviceEventQueue &) = delete;
+
+  ~DeviceEventQueue() {
+    m_sources.clear();
+    stop();
+  }
+
+  DeviceEventQueue &start(const Construct &options) {
+    API_RETURN_VALUE_IF_ERROR(*this);
+    if (options.handler() == nullptr) {
+      API_RETURN_VALUE_ASSIGN_ERROR(*this, "no handler", EINVAL);
+    }
+    stop();
+    m_handler = options.handler();
+    m_context = options.context();
+    m_signal_context = {
+      .tid = 0,
+      .si_signo = int(options.signal_number()),
+      .si_sigcode = SI_USER,
+      .sig_value = 0,
+      .keep = 1};
+
+    {
+      // the worker inherits the blocked signal; only sigwaitinfo() sees it
+      SignalWait blocked(options.signal_number());
+      API_RETURN_VALUE_IF_ERROR(*this);
+      m_is_running = true;
+      m_thread = thread::Thread(
+        thread::Thread::Attributes()
+          .set_stack_size(options.stack_size())
+          .set_detach_state(thread::Thread::DetachState::joinable),
+        thread::Thread::Construct().set_argument(this).set_function(work));
+    }
+    if (is_error()) {
+      m_is_running = false;
+      return *this;
+    }
+
+    // interrupts only signal the worker once its id is known
+    m_signal_context.tid = int(m_thread.id());
+    m_is_started = true;
+    // pick up anything queued before the worker existed
+    ::pthread_kill(m_thread.id(), m_signal_context.si_signo);
+    return *this;
+  }
+
+  // remaining events are handled before the worker exits
+  DeviceEventQueue &stop() {
+    if (!m_is_running) {
+      return *this;
+    }
+    m_is_started = false;
+    m_is_running = false;
+    ::pthread_kill(m_thread.id(), m_signal_context.si_signo);
+    m_thread.join();
+    return *this;
+  }
+
+  // returns the index reported by Event::source(); removed indices are
+  // reused
+  template <class Derived>
+  size_t
+  add(const DeviceAccess<Derived> &device, const CreateAction &options) {
+    return add_file(device.file(), options);
+  }
+
+  DeviceEventQueue &remove(size_t index) {
+    m_sources.remove(index);
+    return *this;
+  }
+
+  API_NO_DISCARD bool is_running() const { return m_is_running; }
+  API_NO_DISCARD u32 dropped_count() const { return m_dropped_count; }
+  static constexpr size_t count() { return Count; }
+
+private:
+  struct Slot {
+    std::atomic<u32> sequence{0};
+    Event event;
+  };
+
+  struct Source : public SignalWait::Source {
+    DeviceEventQueue *queue = nullptr;
+    u16 index = 0;
+  };
+
+  var::Array<Slot, Count> m_slots;
+  std::atomic<u32> m_tail{0};
+  u32 m_head = 0;
+  std::atomic<bool> m_is_signalled{false};
+  std::atomic<bool> m_is_started{false};
+  std::atomic<bool> m_is_running{false};
+  std::atomic<u32> m_dropped_count{0};
+
+  SignalWait::SourceList<Source, maximum_source_count> m_sources;
+  Handler m_handler = nullptr;
+  void *m_context = nullptr;
+  devfs_signal_callback_t m_signal_context{};
+  thread::Thread m_thread;
+
+  size_t
+  add_file(const DeviceObject::DeviceFile &file, const CreateAction &options) {
+    API_RETURN_VALUE_IF_ERROR(maximum_source_count);
+    auto *source = m_sources.allocate();
+    if (source == nullptr) {
+      return maximum_source_count;
+    }
+    const auto index = m_sources.index(*source);
+    source->queue = this;
+    source->index = u16(index);
+    if (!m_sources.attach(
+          *source,
+          file,
+          options.channel(),
+          options.o_events(),
+          options.priority(),
+          handle_event)) {
+      return maximum_source_count;
+    }
+    return index;
+  }
+
+  // any number of interrupts may push; only the worker pops
+  bool push(const Event &event) {
+    u32 position = m_tail.load(std::memory_order_relaxed);
+    while (true) {
+      auto &slot = m_slots.at(position & (Count - 1));
+      const auto sequence = slot.sequence.load(std::memory_order_acquire);
+      const auto difference = s32(sequence - position);
+      if (difference == 0) {
+        if (m_tail.compare_exchange_weak(
+              position,
+              position + 1,
+              std::memory_order_relaxed)) {
+          slot.event = event;
+          slot.sequence.store(position + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (difference < 0) {
+        return false;
+      } else {
+        position = m_tail.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  bool pop(Event &event) {
+    auto &slot = m_slots.at(m_head & (Count - 1));
+    const auto sequence = slot.sequence.load(std::memory_order_acquire);
+    if (s32(sequence - (m_head + 1)) < 0) {
+      // empty, or the next producer has not finished writing
+      return false;
+    }
+    event = slot.event;
+    slot.sequence.store(m_head + Count, std::memory_order_release);
+    m_head++;
+    return true;
+  }
+
+  void drain() {
+    var::Array<Event, BatchSize> batch;
+    size_t count = 0;
+    do {
+      count = 0;
+      while (count < BatchSize && pop(batch.at(count))) {
+        count++;
+      }
+      if (count) {
+        const auto timestamp = chrono::ClockTime::get_system_time(
+          chrono::ClockTime::ClockId::monotonic);
+        for (size_t i = 0; i < count; i++) {
+          batch.at(i).set_timestamp(timestamp);
+        }
+        m_handler(m_context, &batch.at(0), count);
+      }
+    } while (count == BatchSize);
+  }
+
+  void run() {
+    // already blocked by start(), so this leaves the mask alone
+    const SignalWait signal_wait(
+      thread::Signal::Number(m_signal_context.si_signo));
+    while (m_is_running) {
+      // cleared first so a push during drain() signals again
+      m_is_signalled = false;
+      drain();
+      if (m_is_running) {
+        signal_wait.wait();
+      }
+    }
+    drain();
+  }
+
+  static void *work(void *args) {
+    reinterpret_cast<DeviceEventQueue *>(args)->run();
+    return nullptr;
+  }
+
+  static int handle_event(void *context, const mcu_event_t *event) {
+    // runs in interrupt context
+    auto *source = reinterpret_cast<const Source *>(context);
+    auto *queue = source->queue;
+    if (!queue->push(Event()
+                       .set_source(source->index)
+                       .set_channel(source->channel)
+                       .set_o_events(event->o_events))) {
+      queue->m_dropped_count++;
+      return 1;
+    }
+    if (!queue->m_is_signalled.exchange(true) && queue->m_is_started) {
+      devfs_signal_callback(&queue->m_signal_context, event);
+    }
+    return 1;
+  }
+};
+
+} // namespace hal
+
+#endif
+
+#endif // HALAPI_HAL_DEVICE_EVENT_QUEUE_HPP_
@@ -0,0 +1,147 @@
+// Copyright 2020-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#ifndef HALAPI_HAL_DEVICE_EXECUTOR_HPP_
+#define HALAPI_HAL_DEVICE_EXECUTOR_HPP_
+
+#if !defined __link && defined __cpp_impl_coroutine
+
+#include <coroutine>
+#include <exception>
+#include <utility>
+
+#include <var/Vector.hpp>
+
+#include "Device.hpp"
+
+namespace hal {
+
+class DeviceExecutor;
+
+/*! \details
+ *
+ * A coroutine that can co_await DeviceAccess::async_read(),
+ * async_write() and async_transfer(). A task does nothing until it is
+ * handed to DeviceExecutor::spawn().
+ *
+ * ```
+ * hal::DeviceTask echo(const hal::Uart &uart, var::View buffer) {
+ *   const int result = co_await uart.async_read(buffer);
+ *   if (result > 0) {
+ *     co_await uart.async_write(buffer.truncate(result));
+ *   }
+ * }
+ *
+ * hal::DeviceExecutor().spawn(echo(uart, buffer)).run();
+ * ```
+ *
+ */
+class DeviceTask {
+public:
+  class promise_type {
+  public:
+    DeviceTask get_return_object() {
+      return DeviceTask(
+        std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    std::suspend_always final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+
+    API_NO_DISCARD DeviceExecutor *executor() const { return m_executor; }
+
+  private:
+    friend class DeviceExecutor;
+    DeviceExecutor *m_executor = nullptr;
+  };
+
+  DeviceTask() = default;
+  DeviceTask(const DeviceTask &) = delete;
+  DeviceTask &operator=(const DeviceTask &) = delete;
+
+  DeviceTask(DeviceTask &&a) noexcept { std::swap(m_handle, a.m_handle); }
+  DeviceTask &operator=(DeviceTask &&a) noexcept {
+    std::swap(m_handle, a.m_handle);
+    return *this;
+  }
+
+  ~DeviceTask() {
+    if (m_handle) {
+      m_handle.destroy();
+    }
+  }
+
+  API_NO_DISCARD bool is_valid() const { return bool(m_handle); }
+  API_NO_DISCARD bool is_done() const { return !m_handle || m_handle.done(); }
+
+private:
+  friend class DeviceExecutor;
+  std::coroutine_handle<promise_type> m_handle;
+
+  explicit DeviceTask(std::coroutine_handle<promise_type> handle)
+    : m_handle(handle) {}
+};
+
+/*! \details
+ *
+ * Runs DeviceTask coroutines on the calling thread. Each co_await starts
+ * one aio request and parks the task; run() then blocks in a single
+ * aio_suspend() over every outstanding request and resumes the tasks whose
+ * requests have completed. No thread is created and no task blocks another.
+ *
+ */
+class DeviceExecutor : public api::ExecutionContext {
+public:
+  DeviceExecutor() = default;
+  // outstanding requests are cancelled and drained, then unfinished tasks
+  // are destroyed
+  ~DeviceExecutor() {
+    cancel_pending();
+    destroy_tasks();
+  }
+  DeviceExecutor(const DeviceExecutor &) = delete;
+  DeviceExecutor &operator=(const DeviceExecutor &) = delete;
+
+  DeviceExecutor &spawn(DeviceTask &&task);
+
+  // returns when every spawned task has finished; each task is resumed
+  // under its own error scope so one task's error never fails another
+  DeviceExecutor &run();
+
+  API_NO_DISCARD size_t pending_count() const { return m_pending.count(); }
+
+private:
+  friend class DeviceObject::Awaitable;
+
+  struct Pending {
+    const DeviceObject::DeviceFile *file;
+    fs::Aio *aio;
+    bool is_write;
+    std::coroutine_handle<> handle;
+  };
+
+  var::Vector<std::coroutine_handle<DeviceTask::promise_type>> m_tasks;
+  var::Vector<std::coroutine_handle<>> m_ready;
+  var::Vector<Pending> m_pending;
+  // reused by every wait; it only grows when more tasks are pending
+  var::Vector<const struct aiocb *> m_wait_list;
+
+  void add_pending(
+    const DeviceObject::DeviceFile &file,
+    fs::Aio &aio,
+    bool is_write,
+    std::coroutine_handle<> handle) {
+    m_pending.push_back({&file, &aio, is_write, handle});
+  }
+
+  void resume_ready();
+  void cancel_pending();
+  void destroy_tasks();
+  void collect_completed();
+};
+
+} // namespace hal
+
+#endif
+
+#endif // HALAPI_HAL_DEVICE_EXECUTOR_HPP_
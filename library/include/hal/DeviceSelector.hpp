@@ -0,0 +1,112 @@
+// Copyright 2020-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#ifndef HALAPI_HAL_DEVICE_SELECTOR_HPP_
+#define HALAPI_HAL_DEVICE_SELECTOR_HPP_
+
+#if !defined __link
+
+#include <atomic>
+
+#include <sos/fs/devfs.h>
+
+#include <var/Vector.hpp>
+
+#include "SignalWait.hpp"
+
+namespace hal {
+
+/*! \details
+ *
+ * Waits on many devices from one thread. Each added device gets an
+ * I_MCU_SETACTION handler that marks it ready and signals the waiting
+ * thread (like DeviceSignal), so the driver must be configured to raise the
+ * events (for example FIFO_FLAG_NOTIFY_READ on a ByteBuffer). The handler
+ * replaces any action already set on that channel.
+ *
+ * Readiness is edge-triggered: wait() reports a device once per batch of
+ * events and the caller should read (non-blocking) until the device is
+ * empty. Newly added devices are reported ready on the first wait().
+ *
+ * The selector must be constructed, waited on and destroyed by the same
+ * thread; the signal is unblocked again when it is destroyed.
+ *
+ */
+class DeviceSelector : public api::ExecutionContext {
+public:
+  enum class Interest {
+    null = 0,
+    read = MCU_EVENT_FLAG_DATA_READY,
+    write = MCU_EVENT_FLAG_WRITE_COMPLETE
+  };
+
+  static constexpr size_t maximum_count = 32;
+
+  class Event {
+  public:
+    API_AF(Event, size_t, index, 0);
+    API_AF(Event, u32, o_events, 0);
+
+  public:
+    API_NO_DISCARD bool is_readable() const {
+      return o_events() & MCU_EVENT_FLAG_DATA_READY;
+    }
+    API_NO_DISCARD bool is_writable() const {
+      return o_events() & MCU_EVENT_FLAG_WRITE_COMPLETE;
+    }
+  };
+
+  explicit DeviceSelector(
+    thread::Signal::Number signal_number = thread::Signal::Number::user1);
+  ~DeviceSelector();
+
+  DeviceSelector(const DeviceSelector &) = delete;
+  DeviceSelector &operator=(const DeviceSelector &) = delete;
+
+  // returns the index reported by Event::index(); removed indices are reused
+  template <class Derived>
+  size_t add(
+    const DeviceAccess<Derived> &device,
+    Interest interest,
+    u8 channel = 0) {
+    return add_file(device.file(), interest, channel);
+  }
+
+  DeviceSelector &remove(size_t index);
+
+  API_NO_DISCARD size_t count() const { return m_sources.count(); }
+
+  // a zero timeout waits until at least one device is ready
+  const var::Vector<Event> &
+  wait(const chrono::MicroTime &timeout = chrono::MicroTime(0));
+
+  API_NO_DISCARD const var::Vector<Event> &events() const { return m_events; }
+
+private:
+  struct Entry : public SignalWait::Source {
+    DeviceSelector *selector = nullptr;
+    size_t index = 0;
+    std::atomic<u32> o_pending{0};
+  };
+
+  SignalWait m_signal_wait;
+  SignalWait::SourceList<Entry, maximum_count> m_sources;
+  std::atomic<u32> m_ready_mask{0};
+  devfs_signal_callback_t m_signal_context{};
+  var::Vector<Event> m_events;
+
+  size_t add_file(
+    const DeviceObject::DeviceFile &file,
+    Interest interest,
+    u8 channel);
+  bool collect();
+
+  static int handle_event(void *context, const mcu_event_t *event);
+};
+
+API_OR_NAMED_FLAGS_OPERATOR(DeviceSelector, Interest)
+
+} // namespace hal
+
+#endif
+
+#endif // HALAPI_HAL_DEVICE_SELECTOR_HPP_
@@ -62,6 +62,11 @@ public:
       = {.callback = devfs_signal_callback, .context = (void *)&m_context}};
   }
 
+  // for handlers that do their own work before calling devfs_signal_callback
+  API_NO_DISCARD const devfs_signal_callback_t &context() const {
+    return m_context;
+  }
+
 private:
   devfs_signal_callback_t m_context{};
 };
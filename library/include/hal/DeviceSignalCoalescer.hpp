@@ -0,0 +1,113 @@
+// Copyright 2020-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#ifndef HALAPI_HAL_DEVICE_SIGNAL_COALESCER_HPP_
+#define HALAPI_HAL_DEVICE_SIGNAL_COALESCER_HPP_
+
+#if !defined __link
+
+#include <atomic>
+
+#include <var/Vector.hpp>
+
+#include "SignalWait.hpp"
+
+namespace hal {
+
+/*! \details
+ *
+ * Merges bursts of driver events (such as FIFO_FLAG_NOTIFY_READ or timer
+ * matches) into one notification per channel. The driver handler only
+ * counts events. Each channel has its own window: the first event after a
+ * quiet period is reported by wait() at once and opens the window; events
+ * inside the window are counted and reported together when it closes.
+ * The receiving thread handles at most one notification per window per
+ * channel no matter the event rate, and a quiet channel is never delayed.
+ *
+ * The coalescer must be constructed, waited on and destroyed by the same
+ * thread; the signal is unblocked again when it is destroyed.
+ *
+ */
+class DeviceSignalCoalescer : public api::ExecutionContext {
+public:
+  static constexpr size_t maximum_count = 16;
+
+  class Notification {
+  public:
+    // index returned by add()
+    API_AF(Notification, size_t, index, 0);
+    API_AF(Notification, u8, channel, 0);
+    API_AF(Notification, u32, o_events, 0);
+    API_AF(Notification, u32, count, 0);
+  };
+
+  explicit DeviceSignalCoalescer(
+    const chrono::MicroTime &window,
+    thread::Signal::Number signal_number = thread::Signal::Number::user1);
+  ~DeviceSignalCoalescer();
+
+  DeviceSignalCoalescer(const DeviceSignalCoalescer &) = delete;
+  DeviceSignalCoalescer &operator=(const DeviceSignalCoalescer &) = delete;
+
+  // removed indices are reused
+  template <class Derived>
+  size_t add(
+    const DeviceAccess<Derived> &device,
+    const DeviceSignal::CreateAction &options) {
+    return add_file(device.file(), options);
+  }
+
+  DeviceSignalCoalescer &remove(size_t index);
+
+  // the window given to channels added from here on
+  DeviceSignalCoalescer &set_window(const chrono::MicroTime &value) {
+    m_window = value;
+    return *this;
+  }
+
+  DeviceSignalCoalescer &
+  set_window(size_t index, const chrono::MicroTime &value);
+
+  API_NO_DISCARD const chrono::MicroTime &window() const { return m_window; }
+  API_NO_DISCARD size_t count() const { return m_sources.count(); }
+
+  // a zero timeout waits until at least one notification is due
+  const var::Vector<Notification> &
+  wait(const chrono::MicroTime &timeout = chrono::MicroTime(0));
+
+  API_NO_DISCARD const var::Vector<Notification> &notifications() const {
+    return m_notifications;
+  }
+
+private:
+  struct Entry : public SignalWait::Source {
+    DeviceSignalCoalescer *coalescer = nullptr;
+    std::atomic<u32> event_count{0};
+    std::atomic<u32> o_pending{0};
+    // set by the handler once it has raised the signal
+    std::atomic<bool> is_signalled{false};
+    chrono::MicroTime window;
+    // on m_clock; events before this are held for the next notification
+    chrono::MicroTime window_end;
+  };
+
+  DeviceSignal m_signal;
+  SignalWait m_signal_wait;
+  chrono::MicroTime m_window;
+  chrono::ClockTimer m_clock;
+  SignalWait::SourceList<Entry, maximum_count> m_sources;
+  var::Vector<Notification> m_notifications;
+
+  size_t add_file(
+    const DeviceObject::DeviceFile &file,
+    const DeviceSignal::CreateAction &options);
+  // returns when the earliest held window closes, zero if none is held
+  chrono::MicroTime collect(const chrono::MicroTime &now);
+
+  static int handle_event(void *context, const mcu_event_t *event);
+};
+
+} // namespace hal
+
+#endif
+
+#endif // HALAPI_HAL_DEVICE_SIGNAL_COALESCER_HPP_
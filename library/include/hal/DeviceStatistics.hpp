@@ -0,0 +1,78 @@
+// Copyright 2020-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#ifndef HALAPI_HAL_DEVICE_STATISTICS_HPP_
+#define HALAPI_HAL_DEVICE_STATISTICS_HPP_
+
+#include <chrono/MicroTime.hpp>
+#include <var/Array.hpp>
+
+namespace hal {
+
+class DeviceStatistics {
+public:
+  enum class Operation { ioctl, read, write };
+
+  // bucket n counts calls that took less than 2^(n+1) microseconds
+  // the last bucket also counts everything slower
+  static constexpr size_t bucket_count = 20;
+  using Histogram = var::Array<u32, bucket_count>;
+
+  class Entry {
+    API_AF(Entry, Operation, operation, Operation::ioctl);
+    API_AF(Entry, int, request, 0);
+    API_AF(Entry, u32, call_count, 0);
+    API_AF(Entry, u32, error_count, 0);
+    API_AF(Entry, u64, byte_count, 0);
+    API_AC(Entry, chrono::MicroTime, total_time);
+    API_AC(Entry, chrono::MicroTime, maximum_time);
+    API_AC(Entry, Histogram, histogram);
+
+  public:
+    API_NO_DISCARD bool is_valid() const { return call_count() != 0; }
+
+    API_NO_DISCARD chrono::MicroTime average_time() const {
+      return call_count() ? chrono::MicroTime(
+               total_time().microseconds() / call_count())
+                          : chrono::MicroTime();
+    }
+
+  private:
+    friend class DeviceStatistics;
+  };
+
+  // read and write are keyed by operation only, ioctl also by request
+  static constexpr size_t entry_count = 32;
+  using EntryList = var::Array<Entry, entry_count>;
+
+  DeviceStatistics &record(
+    Operation operation,
+    int request,
+    int result,
+    const chrono::MicroTime &duration);
+
+  DeviceStatistics &reset();
+
+  API_NO_DISCARD const EntryList &entries() const { return m_entries; }
+  API_NO_DISCARD const Entry *find(Operation operation, int request = 0) const;
+
+  // calls that could not be recorded because every entry was in use;
+  // once the table overflows the totals no longer cover every call
+  API_NO_DISCARD u32 dropped_count() const { return m_dropped_count; }
+  API_NO_DISCARD bool is_overflow() const { return m_dropped_count != 0; }
+
+  static size_t bucket(const chrono::MicroTime &duration);
+
+private:
+  EntryList m_entries;
+  u32 m_dropped_count = 0;
+};
+
+} // namespace hal
+
+namespace printer {
+class Printer;
+Printer &operator<<(Printer &printer, const hal::DeviceStatistics::Entry &a);
+Printer &operator<<(Printer &printer, const hal::DeviceStatistics &a);
+} // namespace printer
+
+#endif // HALAPI_HAL_DEVICE_STATISTICS_HPP_
@@ -0,0 +1,307 @@
+// Copyright 2020-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#ifndef HALAPI_HAL_EMULATED_DEVICES_HPP_
+#define HALAPI_HAL_EMULATED_DEVICES_HPP_
+
+#include <sos/dev/adc.h>
+#include <sos/dev/cfifo.h>
+#include <sos/dev/drive.h>
+#include <sos/dev/fifo.h>
+#include <sos/dev/flash.h>
+#include <sos/dev/i2c.h>
+#include <sos/dev/pio.h>
+#include <sos/dev/spi.h>
+#include <sos/dev/stream_ffifo.h>
+#include <sos/dev/uart.h>
+
+#include <var/Data.hpp>
+
+#include "BufferMap.hpp"
+#include "Emulator.hpp"
+#include "Spi.hpp"
+
+namespace hal {
+
+// ring of fixed size frames; a frame size of one gives a byte fifo. The
+// ring can be handed to hal::BufferMap in place of mmap.
+class EmulatedFifo : public EmulatedDevice, public BufferMap::Mapping {
+public:
+  EmulatedFifo(u32 frame_size, u32 frame_count);
+
+  int read(int location, void *buf, int nbyte) override;
+  int write(int location, const void *buf, int nbyte) override;
+
+  BufferMap::Region map() override;
+  // size must be a whole number of frames
+  int consume(size_t size) override;
+
+  EmulatedFifo &flush();
+
+  API_NO_DISCARD u32 frame_size() const { return m_frame_size; }
+  API_NO_DISCARD u32 frame_count() const { return m_frame_count; }
+  API_NO_DISCARD u32 frame_count_ready() const { return m_ready_count; }
+  API_NO_DISCARD bool is_writeblock() const override {
+    return m_is_writeblock;
+  }
+
+  // reports (and clears) whether unread frames were overwritten
+  bool take_overflow() {
+    const auto result = m_is_overflow;
+    m_is_overflow = false;
+    return result;
+  }
+
+protected:
+  EmulatedFifo &set_writeblock(bool value) {
+    m_is_writeblock = value;
+    return *this;
+  }
+
+private:
+  var::Data m_buffer;
+  u32 m_frame_size;
+  u32 m_frame_count;
+  u32 m_head = 0;
+  u32 m_tail = 0;
+  u32 m_ready_count = 0;
+  bool m_is_writeblock = false;
+  bool m_is_overflow = false;
+};
+
+// sos fifo driver (hal::ByteBuffer)
+class EmulatedByteBuffer : public EmulatedFifo {
+public:
+  explicit EmulatedByteBuffer(u32 size) : EmulatedFifo(1, size) {}
+  int ioctl(int request, void *argument) override;
+};
+
+// sos cfifo driver (hal::ByteBufferArray); the file location selects the
+// channel
+class EmulatedByteBufferArray : public EmulatedDevice {
+public:
+  EmulatedByteBufferArray(u32 channel_count, u32 size);
+
+  int read(int location, void *buf, int nbyte) override;
+  int write(int location, const void *buf, int nbyte) override;
+  int ioctl(int request, void *argument) override;
+
+  API_NO_DISCARD u32 channel_count() const { return m_channels.count(); }
+  API_NO_DISCARD EmulatedByteBuffer &channel(u32 value) {
+    return m_channels.at(value);
+  }
+
+private:
+  var::Vector<EmulatedByteBuffer> m_channels;
+  var::Vector<int> m_owners;
+  u32 m_size;
+
+  EmulatedByteBuffer *find(u32 channel) {
+    return channel < m_channels.count() ? &m_channels.at(channel) : nullptr;
+  }
+};
+
+// sos ffifo driver (hal::FrameBuffer)
+class EmulatedFrameBuffer : public EmulatedFifo {
+public:
+  EmulatedFrameBuffer(u32 frame_size, u32 frame_count)
+    : EmulatedFifo(frame_size, frame_count) {}
+  int ioctl(int request, void *argument) override;
+  void get_info(ffifo_info_t &info);
+};
+
+// sos stream_ffifo driver (hal::FrameStream), transmit is looped back to
+// receive while the stream is running
+class EmulatedFrameStream : public EmulatedDevice {
+public:
+  EmulatedFrameStream(u32 frame_size, u32 frame_count, u32 bitrate);
+
+  int read(int location, void *buf, int nbyte) override;
+  int write(int location, const void *buf, int nbyte) override;
+  int ioctl(int request, void *argument) override;
+
+  // reported by get_info() until changed, like a latched driver fault
+  EmulatedFrameStream &set_receive_error(s32 value) {
+    m_receive_error = value;
+    return *this;
+  }
+
+  EmulatedFrameStream &set_transmit_error(s32 value) {
+    m_transmit_error = value;
+    return *this;
+  }
+
+private:
+  EmulatedFrameBuffer m_transmit;
+  EmulatedFrameBuffer m_receive;
+  u32 m_bitrate;
+  u32 m_transmit_count = 0;
+  u32 m_receive_count = 0;
+  s32 m_transmit_error = 0;
+  s32 m_receive_error = 0;
+  bool m_is_running = false;
+};
+
+class EmulatedSpi : public EmulatedDevice {
+public:
+  // the argument is a hal::Spi::Transaction run in one submission
+  static constexpr int request_transaction = _IOCTL('e', 2);
+
+  explicit EmulatedSpi(u32 frequency = 1000000);
+
+  int read(int location, void *buf, int nbyte) override;
+  int write(int location, const void *buf, int nbyte) override;
+  int ioctl(int request, void *argument) override;
+
+  // bytes clocked in on MISO, repeated as needed (0xff when empty)
+  EmulatedSpi &set_response(var::View response);
+
+  API_NO_DISCARD bool is_cs_asserted() const { return m_is_cs_asserted; }
+  API_NO_DISCARD u32 frequency() const { return m_attributes.freq; }
+
+private:
+  spi_attr_t m_attributes{};
+  var::Data m_response;
+  size_t m_response_offset = 0;
+  bool m_is_cs_asserted = false;
+
+  void execute(const Spi::Transaction::Segment &segment);
+};
+
+// a single register-addressed slave, like an eeprom or sensor
+class EmulatedI2C : public EmulatedDevice {
+public:
+  explicit EmulatedI2C(u8 slave_address, u32 register_size = 256);
+
+  int read(int location, void *buf, int nbyte) override;
+  int write(int location, const void *buf, int nbyte) override;
+  int ioctl(int request, void *argument) override;
+  API_NO_DISCARD bool is_seekable() const override { return true; }
+
+  API_NO_DISCARD var::View registers() { return var::View(m_registers); }
+
+private:
+  i2c_attr_t m_attributes{};
+  var::Data m_registers;
+  u8 m_slave_address;
+  u32 m_error = I2C_ERROR_NONE;
+
+  int prepare(int location, int nbyte);
+};
+
+// transmit is looped back to receive
+class EmulatedUart : public EmulatedDevice {
+public:
+  explicit EmulatedUart(u32 receive_size = 256, u32 frequency = 115200);
+
+  int read(int location, void *buf, int nbyte) override;
+  int write(int location, const void *buf, int nbyte) override;
+  int ioctl(int request, void *argument) override;
+
+private:
+  uart_attr_t m_attributes{};
+  EmulatedFifo m_receive;
+};
+
+// channels produce a deterministic ramp offset by channel number
+class EmulatedAdc : public EmulatedDevice {
+public:
+  explicit EmulatedAdc(u32 resolution = 12, u32 frequency = 100000);
+
+  int read(int location, void *buf, int nbyte) override;
+  int ioctl(int request, void *argument) override;
+
+private:
+  adc_attr_t m_attributes{};
+  u32 m_resolution;
+  u32 m_sample_count = 0;
+
+  API_NO_DISCARD u32 bytes_per_sample() const {
+    return m_resolution > 16 ? sizeof(u32) : sizeof(u16);
+  }
+};
+
+class EmulatedDrive : public EmulatedDevice {
+public:
+  class Construct {
+    API_AF(Construct, u16, write_block_size, 512);
+    API_AF(Construct, u32, write_block_count, 2048);
+    API_AF(Construct, u32, erase_block_size, 4096);
+    API_AF(
+      Construct,
+      chrono::MicroTime,
+      erase_block_time,
+      chrono::MicroTime(5000));
+    API_AF(Construct, u32, bitrate, 25000000);
+  };
+
+  explicit EmulatedDrive(const Construct &options);
+
+  int read(int location, void *buf, int nbyte) override;
+  int write(int location, const void *buf, int nbyte) override;
+  int ioctl(int request, void *argument) override;
+  API_NO_DISCARD bool is_seekable() const override { return true; }
+
+private:
+  drive_info_t m_info{};
+  var::Data m_memory;
+
+  int erase(u32 start, u32 end);
+};
+
+// program operations can only clear bits, like real flash
+class EmulatedFlash : public EmulatedDevice {
+public:
+  class Construct {
+    API_AF(Construct, u32, page_size, 2048);
+    API_AF(Construct, u32, page_count, 64);
+    API_AF(
+      Construct,
+      chrono::MicroTime,
+      erase_page_time,
+      chrono::MicroTime(20000));
+    API_AF(Construct, u32, bitrate, 8000000);
+  };
+
+  explicit EmulatedFlash(const Construct &options);
+
+  int read(int location, void *buf, int nbyte) override;
+  int ioctl(int request, void *argument) override;
+  API_NO_DISCARD bool is_seekable() const override { return true; }
+
+private:
+  var::Data m_memory;
+  u32 m_page_size;
+  u32 m_page_count;
+  chrono::MicroTime m_erase_page_time;
+  u32 m_bitrate;
+
+  int write_page(const flash_writepage_t &write_page);
+  int erase_page(u32 page);
+};
+
+// pio port; pins configured as inputs read back the external value
+class EmulatedGpio : public EmulatedDevice {
+public:
+  int ioctl(int request, void *argument) override;
+
+  EmulatedGpio &set_input(u32 value) {
+    m_input = value;
+    return *this;
+  }
+
+  API_NO_DISCARD u32 output() const { return m_output; }
+  API_NO_DISCARD u32 direction() const { return m_direction; }
+
+  API_NO_DISCARD u32 value() const {
+    return (m_output & m_direction) | (m_input & ~m_direction);
+  }
+
+private:
+  u32 m_direction = 0;
+  u32 m_output = 0;
+  u32 m_input = 0;
+};
+
+} // namespace hal
+
+#endif // HALAPI_HAL_EMULATED_DEVICES_HPP_
@@ -0,0 +1,132 @@
+// Copyright 2020-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#ifndef HALAPI_HAL_EMULATOR_HPP_
+#define HALAPI_HAL_EMULATOR_HPP_
+
+#include <cerrno>
+#include <utility>
+
+#include <sos/dev/mcu.h>
+
+#include <chrono/MicroTime.hpp>
+#include <fs/File.hpp>
+#include <var/StackString.hpp>
+
+namespace hal {
+
+/*! \details
+ *
+ * In-process stand-in for a devfs driver. Calls return the number of
+ * bytes (or the ioctl result) on success and -1 with errno set on failure,
+ * just like the system calls they replace.
+ *
+ * Emulated drivers never block. Timing is charged to the Emulator clock
+ * instead of being slept so benchmarks are deterministic.
+ *
+ */
+class EmulatedDevice {
+public:
+  virtual ~EmulatedDevice() = default;
+
+  virtual int read(int location, void *buf, int nbyte) {
+    return set_error(ENOTSUP);
+  }
+
+  virtual int write(int location, const void *buf, int nbyte) {
+    return set_error(ENOTSUP);
+  }
+
+  // drivers pass requests they don't handle here (I_MCU_SETACTION)
+  virtual int ioctl(int request, void *argument);
+
+  // location is advanced by read/write only for addressable devices
+  API_NO_DISCARD virtual bool is_seekable() const { return false; }
+
+protected:
+  static int set_error(int error_number) {
+    errno = error_number;
+    return -1;
+  }
+
+  // charges the time to shift bit_count bits at bitrate (bits per second)
+  static void charge(u64 bit_count, u32 bitrate);
+
+  // held by EmulatedFile around each driver call; take it in any other
+  // entry point that touches driver state
+  class Lock {
+  public:
+    Lock();
+    ~Lock();
+    Lock(const Lock &) = delete;
+    Lock &operator=(const Lock &) = delete;
+  };
+
+  // queues the callback registered with I_MCU_SETACTION if it wants
+  // o_events; it runs once the driver call returns and the emulator lock
+  // is released, so the callback may use emulated devices itself
+  void notify(u32 o_events, void *data = nullptr);
+
+private:
+  friend class EmulatedFile;
+  mcu_action_t m_action{};
+
+  static void run_notifications();
+};
+
+class Emulator {
+public:
+  // the device must outlive its registration
+  static void add(var::StringView path, EmulatedDevice &device);
+  static void remove(var::StringView path);
+  static void clear();
+  API_NO_DISCARD static EmulatedDevice *find(var::StringView path);
+
+  // virtual time consumed by emulated hardware since the last reset
+  API_NO_DISCARD static chrono::MicroTime clock();
+  static void advance(const chrono::MicroTime &duration);
+  static void reset_clock();
+};
+
+// routes fs::File calls to the device registered at the path
+class EmulatedFile : public fs::FileAccess<EmulatedFile> {
+public:
+  EmulatedFile() = default;
+  explicit EmulatedFile(
+    var::StringView path,
+    fs::OpenMode open_mode
+    = fs::OpenMode::read_only() FSAPI_LINK_DECLARE_DRIVER_NULLPTR_LAST);
+
+  EmulatedFile(const EmulatedFile &) = delete;
+  EmulatedFile &operator=(const EmulatedFile &) = delete;
+
+  EmulatedFile(EmulatedFile &&a) noexcept { swap(a); }
+  EmulatedFile &operator=(EmulatedFile &&a) noexcept {
+    swap(a);
+    return *this;
+  }
+
+  API_NO_DISCARD int fileno() const { return m_fileno; }
+  API_NO_DISCARD bool is_valid() const { return m_device != nullptr; }
+  API_NO_DISCARD EmulatedDevice *device() const { return m_device; }
+
+protected:
+  int interface_lseek(int offset, int whence) const override;
+  int interface_read(void *buf, int nbyte) const override;
+  int interface_write(const void *buf, int nbyte) const override;
+  int interface_ioctl(int request, void *argument) const override;
+
+private:
+  EmulatedDevice *m_device = nullptr;
+  int m_fileno = -1;
+  mutable int m_location = 0;
+
+  void swap(EmulatedFile &a) {
+    std::swap(m_device, a.m_device);
+    std::swap(m_fileno, a.m_fileno);
+    std::swap(m_location, a.m_location);
+  }
+};
+
+} // namespace hal
+
+#endif // HALAPI_HAL_EMULATOR_HPP_
@@ -0,0 +1,113 @@
+// Copyright 2020-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#ifndef HALAPI_HAL_FRAME_BUFFER_READER_HPP_
+#define HALAPI_HAL_FRAME_BUFFER_READER_HPP_
+
+#include <var/Data.hpp>
+
+#include "FrameBuffer.hpp"
+
+namespace hal {
+
+/*! \details
+ *
+ * Reads every ready frame of a FrameBuffer with a single read into an
+ * arena that is allocated once, then hands the frames out as views into
+ * the arena.
+ *
+ * ```cpp
+ * FrameBufferReader reader(frame_buffer);
+ * for (const auto frame : reader.read()) {
+ *   parse(frame);
+ * }
+ * ```
+ *
+ * Open the FrameBuffer non-blocking to get only what is ready; an empty
+ * fifo then gives an empty range. The frames are valid until the next
+ * read().
+ *
+ */
+class FrameBufferReader : public api::ExecutionContext {
+public:
+  class Iterator {
+  public:
+    Iterator(const u8 *frame, u32 frame_size)
+      : m_frame(frame), m_frame_size(frame_size) {}
+
+    var::View operator*() const { return var::View(m_frame, m_frame_size); }
+
+    Iterator &operator++() {
+      m_frame += m_frame_size;
+      return *this;
+    }
+
+    bool operator!=(const Iterator &a) const { return m_frame != a.m_frame; }
+    bool operator==(const Iterator &a) const { return m_frame == a.m_frame; }
+
+  private:
+    const u8 *m_frame;
+    u32 m_frame_size;
+  };
+
+  class Frames {
+  public:
+    Frames() = default;
+    Frames(const u8 *data, u32 frame_size, u32 count)
+      : m_data(data), m_frame_size(frame_size), m_count(count) {}
+
+    API_NO_DISCARD Iterator begin() const {
+      return Iterator(m_data, m_frame_size);
+    }
+    API_NO_DISCARD Iterator end() const {
+      return Iterator(m_data + m_frame_size * m_count, m_frame_size);
+    }
+
+    API_NO_DISCARD u32 count() const { return m_count; }
+    API_NO_DISCARD bool is_empty() const { return m_count == 0; }
+    API_NO_DISCARD var::View at(u32 offset) const {
+      return var::View(m_data + m_frame_size * offset, m_frame_size);
+    }
+
+    // all frames as one contiguous view
+    API_NO_DISCARD var::View view() const {
+      return var::View(m_data, m_frame_size * m_count);
+    }
+
+  private:
+    const u8 *m_data = nullptr;
+    u32 m_frame_size = 0;
+    u32 m_count = 0;
+  };
+
+  // a frame_count of zero makes room for the whole fifo
+  explicit FrameBufferReader(
+    const FrameBuffer &frame_buffer,
+    u32 frame_count = 0);
+
+  // for other devices that read out of a frame fifo, such as the receive
+  // channel of a FrameStream
+  FrameBufferReader(
+    const DeviceObject::DeviceFile &file,
+    const FrameBuffer::Info &info,
+    u32 frame_count = 0);
+
+  FrameBufferReader(const FrameBufferReader &) = delete;
+  FrameBufferReader &operator=(const FrameBufferReader &) = delete;
+
+  const Frames &read();
+
+  API_NO_DISCARD const Frames &frames() const { return m_frames; }
+  API_NO_DISCARD u32 frame_size() const { return m_frame_size; }
+  API_NO_DISCARD u32 frame_count() const { return m_frame_count; }
+
+private:
+  const DeviceObject::DeviceFile *m_file;
+  u32 m_frame_size = 0;
+  u32 m_frame_count = 0;
+  var::Data m_arena;
+  Frames m_frames;
+};
+
+} // namespace hal
+
+#endif // HALAPI_HAL_FRAME_BUFFER_READER_HPP_
@@ -0,0 +1,86 @@
+// Copyright 2020-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#ifndef HALAPI_HAL_FRAME_POOL_HPP_
+#define HALAPI_HAL_FRAME_POOL_HPP_
+
+#include <var/Data.hpp>
+
+#include "FrameBuffer.hpp"
+
+namespace hal {
+
+/*! \details
+ *
+ * Fixed pool of frame slots, sized by FrameBuffer::Info::frame_size(), for
+ * producers that build frames in place. Slots are handed out in ring order
+ * by `acquire()` and must be submitted in the same order. Submitted frames
+ * are written to the FrameBuffer by `flush()` (or automatically once
+ * `batch_count` are waiting). Neighbouring frames go out in a single write,
+ * or two when the run wraps around the end of the pool.
+ *
+ * ```cpp
+ * FramePool pool(frame_buffer, 32);
+ * pool.set_batch_count(8);
+ * auto frame = pool.acquire();
+ * fill(frame);
+ * pool.submit();
+ * ```
+ *
+ */
+class FramePool : public api::ExecutionContext {
+public:
+  // a frame_count of zero matches the fifo
+  explicit FramePool(const FrameBuffer &frame_buffer, u32 frame_count = 0);
+
+  FramePool(const FramePool &) = delete;
+  FramePool &operator=(const FramePool &) = delete;
+
+  // an empty view means every slot is in use and flush() could not free any
+  var::View acquire();
+
+  // submits the oldest acquired frame
+  FramePool &submit();
+  FramePool &flush();
+
+  FramePool &set_batch_count(u32 value) {
+    m_batch_count = value;
+    return *this;
+  }
+
+  API_NO_DISCARD u32 batch_count() const { return m_batch_count; }
+  API_NO_DISCARD u32 frame_size() const { return m_frame_size; }
+  API_NO_DISCARD u32 frame_count() const { return m_frame_count; }
+  API_NO_DISCARD u32 acquired_count() const { return m_acquired_count; }
+  API_NO_DISCARD u32 submitted_count() const { return m_submitted_count; }
+  API_NO_DISCARD u32 free_count() const {
+    return m_frame_count - m_submitted_count - m_acquired_count;
+  }
+
+private:
+  const FrameBuffer &m_frame_buffer;
+  u32 m_frame_size = 0;
+  u32 m_frame_count = 0;
+  u32 m_batch_count = 1;
+  // slot of the oldest submitted frame; the submitted frames follow it in
+  // ring order, then the acquired ones
+  u32 m_tail = 0;
+  u32 m_submitted_count = 0;
+  u32 m_acquired_count = 0;
+  var::Data m_arena;
+
+  // index is less than twice the frame count
+  var::View slot(u32 index, u32 count = 1) {
+    if (index >= m_frame_count) {
+      index -= m_frame_count;
+    }
+    return var::View(
+      m_arena.data_u8() + index * m_frame_size,
+      m_frame_size * count);
+  }
+
+  u32 write(u32 count);
+};
+
+} // namespace hal
+
+#endif // HALAPI_HAL_FRAME_POOL_HPP_
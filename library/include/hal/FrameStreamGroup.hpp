@@ -0,0 +1,74 @@
+// Copyright 2020-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#ifndef HALAPI_HAL_FRAME_STREAM_GROUP_HPP_
+#define HALAPI_HAL_FRAME_STREAM_GROUP_HPP_
+
+#include <var/Array.hpp>
+
+#include "FrameStream.hpp"
+
+namespace hal {
+
+/*! \details
+ *
+ * Starts several FrameStream devices as close together as software
+ * allows. The stream_ffifo driver has no arm/trigger step, so the streams
+ * are started one after another: prepare() stops and flushes every stream
+ * ahead of time, and start() is nothing but the start requests issued back
+ * to back. Each request is timed, and the offset of its midpoint from the
+ * first one is kept as the start skew of that stream. Samples can be lined
+ * up by that offset instead of by cross-correlation.
+ *
+ * If a start request fails, the streams already started are stopped again
+ * and failed_index() names the stream that failed. It also names the
+ * stream whose stop or flush failed in prepare().
+ *
+ * ```cpp
+ * FrameStreamGroup group;
+ * group.add(i2s).add(adc).prepare().start();
+ * const auto adc_offset = group.skew(1);
+ * ```
+ *
+ */
+class FrameStreamGroup : public api::ExecutionContext {
+public:
+  static constexpr size_t maximum_count = 8;
+
+  FrameStreamGroup &add(const FrameStream &stream);
+
+  // stops and flushes every stream so start() does nothing else
+  FrameStreamGroup &prepare();
+  FrameStreamGroup &start();
+  FrameStreamGroup &stop();
+
+  API_NO_DISCARD size_t count() const { return m_count; }
+
+  // when the stream at index started, relative to the first
+  API_NO_DISCARD chrono::MicroTime skew(size_t index) const {
+    return index < m_count ? m_skew.at(index) : chrono::MicroTime();
+  }
+
+  API_NO_DISCARD chrono::MicroTime maximum_skew() const {
+    return m_count ? m_skew.at(m_count - 1) : chrono::MicroTime();
+  }
+
+  // time spent in the slowest start request; the skew is only this precise
+  API_NO_DISCARD chrono::MicroTime resolution() const { return m_resolution; }
+
+  // the stream that failed in the last prepare() or start(), or count()
+  // if none did
+  API_NO_DISCARD size_t failed_index() const {
+    return m_failed_index < m_count ? m_failed_index : m_count;
+  }
+
+private:
+  var::Array<const FrameStream *, maximum_count> m_streams;
+  var::Array<chrono::MicroTime, maximum_count> m_skew;
+  size_t m_count = 0;
+  size_t m_failed_index = maximum_count;
+  chrono::MicroTime m_resolution;
+};
+
+} // namespace hal
+
+#endif // HALAPI_HAL_FRAME_STREAM_GROUP_HPP_
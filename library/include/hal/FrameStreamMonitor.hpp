@@ -0,0 +1,96 @@
+// Copyright 2020-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#ifndef HALAPI_HAL_FRAME_STREAM_MONITOR_HPP_
+#define HALAPI_HAL_FRAME_STREAM_MONITOR_HPP_
+
+#include <chrono/ClockTimer.hpp>
+
+#include "FrameStream.hpp"
+
+namespace hal {
+
+/*! \details
+ *
+ * Tracks the health of a running FrameStream from periodic get_info()
+ * samples. Call update() at a steady interval (for example from a timer
+ * thread). Each call compares the new sample with the last one to work out
+ * frame rates, errors, overflows and how far receive and transmit have
+ * drifted apart. The callback runs when a threshold is crossed, so an
+ * underrun shows up in the log instead of in the audio.
+ *
+ */
+class FrameStreamMonitor : public api::ExecutionContext {
+public:
+  enum class Alert {
+    none = 0,
+    // the receive fifo is nearly full: the reader is falling behind
+    receive_overrun = 0x01,
+    // the transmit fifo is nearly empty: the writer is falling behind
+    transmit_underrun = 0x02,
+    receive_overflow = 0x04,
+    receive_error = 0x08,
+    transmit_error = 0x10,
+    drift = 0x20
+  };
+
+  class ChannelStatistics {
+    API_AF(ChannelStatistics, u32, frame_count, 0);
+    API_AF(ChannelStatistics, u32, frames_per_second, 0);
+    API_AF(ChannelStatistics, u32, frame_count_ready, 0);
+    // times the error value or the overflow flag changed to set
+    API_AF(ChannelStatistics, u32, error_count, 0);
+    API_AF(ChannelStatistics, u32, overflow_count, 0);
+    API_AF(ChannelStatistics, s32, error, 0);
+  };
+
+  class Statistics {
+    API_AC(Statistics, ChannelStatistics, receive);
+    API_AC(Statistics, ChannelStatistics, transmit);
+    // receive frames minus transmit frames since the monitor started
+    API_AF(Statistics, s32, drift, 0);
+    API_AC(Statistics, chrono::MicroTime, interval);
+    API_AF(Statistics, Alert, alerts, Alert::none);
+  };
+
+  using Callback = void (*)(void *context, const Statistics &statistics);
+
+  class Construct {
+    API_AF(Construct, Callback, callback, nullptr);
+    API_AF(Construct, void *, context, nullptr);
+    // zero means one frame short of a full fifo, but at least one frame
+    API_AF(Construct, u32, receive_high_water, 0);
+    API_AF(Construct, u32, transmit_low_water, 1);
+    // zero ignores drift
+    API_AF(Construct, u32, maximum_drift, 0);
+  };
+
+  FrameStreamMonitor(const FrameStream &stream, const Construct &options);
+
+  // samples the stream; runs the callback if any alert is raised
+  const Statistics &update();
+
+  API_NO_DISCARD const Statistics &statistics() const { return m_statistics; }
+
+  FrameStreamMonitor &reset();
+
+private:
+  const FrameStream &m_stream;
+  Construct m_construct;
+  chrono::ClockTimer m_timer;
+  stream_ffifo_info_t m_last{};
+  bool m_is_first = true;
+  s32 m_drift = 0;
+  Statistics m_statistics;
+
+  static ChannelStatistics update_channel(
+    const stream_ffifo_channel_info_t &current,
+    const stream_ffifo_channel_info_t &last,
+    const ChannelStatistics &previous,
+    const chrono::MicroTime &interval);
+};
+
+API_OR_NAMED_FLAGS_OPERATOR(FrameStreamMonitor, Alert)
+
+} // namespace hal
+
+#endif // HALAPI_HAL_FRAME_STREAM_MONITOR_HPP_
@@ -0,0 +1,174 @@
+// Copyright 2020-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#ifndef HALAPI_HAL_FRAME_STREAM_PIPELINE_HPP_
+#define HALAPI_HAL_FRAME_STREAM_PIPELINE_HPP_
+
+#include <thread/Cond.hpp>
+#include <thread/Mutex.hpp>
+#include <thread/Thread.hpp>
+#include <var/Array.hpp>
+#include <var/Data.hpp>
+
+#include "FrameStream.hpp"
+
+namespace hal {
+
+/*! \details
+ *
+ * Moves frames from the receive channel of a FrameStream through a chain
+ * of stages to a sink. Each stage reads from a bounded queue of
+ * `queue_depth` frames (two gives double buffering) and writes into the
+ * next one. A stage only runs when its output queue has room, and the sink
+ * may refuse a frame, so a slow consumer holds frames back up the chain
+ * and finally in the driver's receive fifo.
+ *
+ * Without threads, call process() from the application loop; it moves as
+ * many frames as it can without blocking (open the stream non-blocking).
+ * With IsThreaded::yes, start() runs the source, every stage and the sink
+ * on their own threads so I/O overlaps processing. A threaded source blocks
+ * in read(), so stop() returns once the stream delivers its next frame.
+ *
+ * A read that fails with anything but EAGAIN stops the pipeline. process()
+ * or stop() reports the error, and error_number() keeps it until the next
+ * start().
+ *
+ */
+class FrameStreamPipeline : public api::ExecutionContext {
+public:
+  static constexpr size_t maximum_stage_count = 8;
+  static constexpr u32 maximum_queue_depth = 16;
+
+  enum class IsThreaded { no, yes };
+
+  // returns the output size in bytes; zero drops the frame
+  using StageFunction
+    = size_t (*)(void *context, var::View input, var::View output);
+  // returns false to keep the frame and retry later
+  using SinkFunction = bool (*)(void *context, var::View frame);
+
+  class Stage {
+    API_AF(Stage, StageFunction, function, nullptr);
+    API_AF(Stage, void *, context, nullptr);
+    // zero keeps the input frame size
+    API_AF(Stage, u32, frame_size, 0);
+  };
+
+  class Sink {
+    API_AF(Sink, SinkFunction, function, nullptr);
+    API_AF(Sink, void *, context, nullptr);
+  };
+
+  class Construct {
+    API_AF(Construct, u32, queue_depth, 2);
+    API_AF(Construct, IsThreaded, is_threaded, IsThreaded::no);
+    API_AF(Construct, u32, stack_size, 4096);
+  };
+
+  FrameStreamPipeline(const FrameStream &stream, const Construct &options);
+  ~FrameStreamPipeline() {
+    api::ErrorScope error_scope;
+    stop();
+  }
+
+  FrameStreamPipeline(const FrameStreamPipeline &) = delete;
+  FrameStreamPipeline &operator=(const FrameStreamPipeline &) = delete;
+
+  FrameStreamPipeline &add_stage(const Stage &stage);
+  FrameStreamPipeline &set_sink(const Sink &sink);
+
+  // single-threaded: returns the number of frames given to the sink
+  u32 process();
+
+  // threaded
+  FrameStreamPipeline &start();
+  FrameStreamPipeline &stop();
+
+  API_NO_DISCARD bool is_running() const { return m_is_running; }
+  API_NO_DISCARD size_t stage_count() const { return m_stage_count; }
+  API_NO_DISCARD u32 dropped_count() const { return m_dropped_count; }
+  // the read error that stopped the pipeline, or zero
+  API_NO_DISCARD int error_number() const { return m_error_number; }
+
+private:
+  // single producer, single consumer ring of frame slots
+  class Queue {
+  public:
+    void initialize(u32 frame_size, u32 depth);
+
+    API_NO_DISCARD bool is_empty() const { return m_count == 0; }
+    API_NO_DISCARD bool is_full() const { return m_count == m_depth; }
+    API_NO_DISCARD u32 frame_size() const { return m_frame_size; }
+
+    var::View back() { return slot(m_head); }
+    void push(u32 size) {
+      m_size.at(m_head) = size;
+      m_head = next(m_head);
+      m_count++;
+    }
+
+    var::View front() { return slot(m_tail).truncate(m_size.at(m_tail)); }
+    void pop() {
+      m_tail = next(m_tail);
+      m_count--;
+    }
+
+  private:
+    var::Data m_arena;
+    var::Array<u32, maximum_queue_depth> m_size;
+    u32 m_frame_size = 0;
+    u32 m_depth = 0;
+    // slot indices, so any depth wraps cleanly
+    u32 m_head = 0;
+    u32 m_tail = 0;
+    u32 m_count = 0;
+
+    API_NO_DISCARD u32 next(u32 index) const {
+      return index + 1 == m_depth ? 0 : index + 1;
+    }
+
+    var::View slot(u32 index) {
+      return var::View(m_arena.data_u8() + index * m_frame_size, m_frame_size);
+    }
+  };
+
+  struct Worker {
+    FrameStreamPipeline *pipeline = nullptr;
+    // stage index; stage_count() is the sink, -1 the source
+    int index = 0;
+  };
+
+  const FrameStream &m_stream;
+  Construct m_construct;
+  var::Array<Stage, maximum_stage_count> m_stages;
+  size_t m_stage_count = 0;
+  Sink m_sink;
+  // queue i feeds stage i; the last feeds the sink
+  var::Array<Queue, maximum_stage_count + 1> m_queues;
+  u32 m_dropped_count = 0;
+  int m_error_number = 0;
+
+  thread::Mutex m_mutex;
+  thread::Cond m_cond{m_mutex};
+  bool m_is_running = false;
+  var::Array<Worker, maximum_stage_count + 2> m_workers;
+  var::Array<thread::Thread, maximum_stage_count + 2> m_threads;
+  // threads that were created and must be joined
+  size_t m_thread_count = 0;
+
+  // each moves one frame if it can; called with m_mutex held
+  // a read error other than EAGAIN goes to m_error_number
+  bool run_source();
+  bool run_stage(size_t index);
+  bool run_sink();
+  bool run(int index);
+  // the source or sink could have moved a frame but the device said no
+  bool is_blocked_outside(int index);
+
+  void join_threads();
+  void work(int index);
+  static void *work_thread(void *args);
+};
+
+} // namespace hal
+
+#endif // HALAPI_HAL_FRAME_STREAM_PIPELINE_HPP_
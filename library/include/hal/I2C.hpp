@@ -52,6 +52,8 @@ public:
   class Attributes {
   public:
     Attributes() {
+      // AttributeCache compares the padding too
+      var::View(m_attributes).fill<u8>(0);
       set_frequency(100000);
       var::View(m_attributes.pin_assignment).fill<u8>(0xff);
     }
@@ -131,7 +133,10 @@ public:
 
   I2C() = default;
 
-  const I2C &set_attributes() const { return ioctl(I_I2C_SETATTR); }
+  const I2C &set_attributes() const {
+    invalidate_attribute_cache();
+    return ioctl(I_I2C_SETATTR);
+  }
 
   I2C &set_attributes() { return API_CONST_CAST_SELF(I2C, set_attributes); }
 
@@ -140,7 +145,7 @@ public:
   API_NO_DISCARD ScanResult scan() const;
 
   const I2C &set_attributes(const Attributes &attributes) const {
-    return ioctl(I_I2C_SETATTR, (void *)&attributes.m_attributes);
+    return apply_attributes(I_I2C_SETATTR, attributes.m_attributes);
   }
 
   I2C &set_attributes(const Attributes &attributes) {
@@ -159,6 +164,7 @@ public:
   }
 
   const I2C &reset() const {
+    invalidate_attribute_cache();
     Attributes attributes = Attributes().set_flags(Flags::reset);
     return ioctl(I_I2C_SETATTR, &attributes.m_attributes);
   }
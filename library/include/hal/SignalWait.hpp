@@ -0,0 +1,163 @@
+// Copyright 2020-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#ifndef HALAPI_HAL_SIGNAL_WAIT_HPP_
+#define HALAPI_HAL_SIGNAL_WAIT_HPP_
+
+#if !defined __link
+
+#include <csignal>
+
+#include <chrono/ClockTimer.hpp>
+#include <thread/Signal.hpp>
+#include <var/Array.hpp>
+
+#include "Device.hpp"
+
+namespace hal {
+
+/*! \details
+ *
+ * Blocks a signal for the calling thread so that driver handlers can wake
+ * it without running a signal handler, and waits for it with
+ * sigwaitinfo()/sigtimedwait(). If the signal was not blocked before, the
+ * destructor discards any pending instance and unblocks it again, so it
+ * must run on the thread that constructed the object.
+ *
+ * SourceList keeps the I_MCU_SETACTION handlers that raise the signal.
+ *
+ */
+class SignalWait : public api::ExecutionContext {
+public:
+  // one handler registration; the owner's entry type derives from it
+  struct Source {
+    const DeviceObject::DeviceFile *file = nullptr;
+    u8 channel = 0;
+    u32 o_events = 0;
+  };
+
+  // the entry address is the handler context, so entries never move
+  template <class Entry, size_t Count>
+  class SourceList : public api::ExecutionContext {
+  public:
+    SourceList() = default;
+    SourceList(const SourceList &) = delete;
+    SourceList &operator=(const SourceList &) = delete;
+
+    // a free slot, removed ones first; set the owner's fields, then attach()
+    Entry *allocate() {
+      API_RETURN_VALUE_IF_ERROR(nullptr);
+      for (auto &entry : m_entries) {
+        if (entry.file == nullptr) {
+          return &entry;
+        }
+      }
+      API_RETURN_VALUE_ASSIGN_ERROR(nullptr, "too many devices", ENOSPC);
+    }
+
+    // installs callback with the entry as context; on failure the slot
+    // stays free
+    bool attach(
+      Entry &entry,
+      const DeviceObject::DeviceFile &file,
+      u8 channel,
+      u32 o_events,
+      u32 priority,
+      mcu_callback_t callback) {
+      API_RETURN_VALUE_IF_ERROR(false);
+      entry.file = &file;
+      entry.channel = channel;
+      entry.o_events = o_events;
+      set_action(entry, priority, callback);
+      if (is_error()) {
+        entry.file = nullptr;
+        return false;
+      }
+      const auto next = index(entry) + 1;
+      m_slot_count = next > m_slot_count ? next : m_slot_count;
+      return true;
+    }
+
+    SourceList &remove(size_t index) {
+      if (index >= m_slot_count || m_entries.at(index).file == nullptr) {
+        API_RETURN_VALUE_ASSIGN_ERROR(*this, "no such device", EINVAL);
+      }
+      auto &entry = m_entries.at(index);
+      set_action(entry, 0, nullptr);
+      entry.file = nullptr;
+      return *this;
+    }
+
+    // removes every source, even with the context in error
+    SourceList &clear() {
+      api::ErrorScope error_scope;
+      for (size_t i = 0; i < m_slot_count; i++) {
+        if (m_entries.at(i).file != nullptr) {
+          remove(i);
+        }
+      }
+      m_slot_count = 0;
+      return *this;
+    }
+
+    Entry &at(size_t index) { return m_entries.at(index); }
+    const Entry &at(size_t index) const { return m_entries.at(index); }
+
+    API_NO_DISCARD size_t index(const Entry &entry) const {
+      return size_t(&entry - &m_entries.at(0));
+    }
+
+    // one past the highest slot used; slots below it may be free
+    API_NO_DISCARD size_t slot_count() const { return m_slot_count; }
+
+    API_NO_DISCARD size_t count() const {
+      size_t result = 0;
+      for (size_t i = 0; i < m_slot_count; i++) {
+        result += m_entries.at(i).file != nullptr;
+      }
+      return result;
+    }
+
+  private:
+    var::Array<Entry, Count> m_entries;
+    size_t m_slot_count = 0;
+
+    static void
+    set_action(const Entry &entry, u32 priority, mcu_callback_t callback) {
+      mcu_action_t action = {
+        .channel = entry.channel,
+        .prio = s8(priority),
+        .o_events = entry.o_events,
+        .handler
+        = {.callback = callback,
+           .context = callback ? (void *)&entry : nullptr}};
+      entry.file->ioctl(I_MCU_SETACTION, &action);
+    }
+  };
+
+  explicit SignalWait(thread::Signal::Number signal_number);
+  ~SignalWait();
+
+  SignalWait(const SignalWait &) = delete;
+  SignalWait &operator=(const SignalWait &) = delete;
+
+  // true when signalled (or interrupted), false once timer passes timeout;
+  // a zero timeout never expires
+  bool wait(
+    const chrono::ClockTimer &timer,
+    const chrono::MicroTime &timeout) const;
+
+  bool wait() const { return wait(chrono::ClockTimer(), chrono::MicroTime()); }
+
+  API_NO_DISCARD int signal_number() const { return m_signal_number; }
+
+private:
+  int m_signal_number;
+  sigset_t m_set;
+  bool m_is_restore = false;
+};
+
+} // namespace hal
+
+#endif
+
+#endif // HALAPI_HAL_SIGNAL_WAIT_HPP_
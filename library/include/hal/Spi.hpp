@@ -5,6 +5,9 @@
 
 #include <sos/dev/spi.h>
 
+#include <var/Array.hpp>
+#include <var/Data.hpp>
+
 #include "Device.hpp"
 
 namespace hal {
@@ -47,6 +50,8 @@ public:
   class Attributes {
   public:
     Attributes() {
+      // AttributeCache compares the padding too
+      var::View(m_attributes).fill<u8>(0);
       set_flags(
         Flags::set_master | Flags::is_format_spi | Flags::is_mode0
         | Flags::set_half_duplex);
@@ -101,6 +106,103 @@ public:
     mutable spi_attr_t m_attributes{};
   };
 
+  /*! \details
+   *
+   * A list of steps for one device exchange, built once and run with
+   * execute(). Only the emulated driver takes the whole list in one ioctl.
+   * The Stratify OS drivers have no transaction request, so on hardware
+   * each step is still its own call, run in order with prebuilt chip
+   * select attributes. Host (link) builds have no aio for a full duplex
+   * transfer step and exchange it one frame at a time with I_SPI_SWAP
+   * instead. The views must outlive execute().
+   *
+   * ```cpp
+   * Spi::Transaction transaction;
+   * transaction.assert_cs().write(command).read(response).deassert_cs();
+   * spi.execute(transaction);
+   * ```
+   *
+   */
+  class Transaction {
+  public:
+    enum class Type : u8 {
+      assert_cs,
+      deassert_cs,
+      write,
+      read,
+      transfer,
+      delay
+    };
+
+    // plain data so a driver can walk the list
+    struct Segment {
+      Type type;
+      // bytes, or microseconds for a delay
+      u32 size;
+      const void *source;
+      void *destination;
+    };
+
+    static constexpr size_t maximum_segment_count = 16;
+
+    Transaction &assert_cs() { return push({Type::assert_cs, 0}); }
+    Transaction &deassert_cs() { return push({Type::deassert_cs, 0}); }
+
+    Transaction &write(var::View source) {
+      return push({Type::write, u32(source.size()), source.to_const_void()});
+    }
+
+    Transaction &read(var::View destination) {
+      return push(
+        {Type::read, u32(destination.size()), nullptr, destination.to_void()});
+    }
+
+    // full duplex; the views must be the same size
+    Transaction &transfer(var::View source, var::View destination) {
+      if (source.size() != destination.size()) {
+        m_is_valid = false;
+        return *this;
+      }
+      return push(
+        {Type::transfer,
+         u32(source.size()),
+         source.to_const_void(),
+         destination.to_void()});
+    }
+
+    Transaction &delay(const chrono::MicroTime &duration) {
+      return push({Type::delay, u32(duration.microseconds())});
+    }
+
+    Transaction &clear() {
+      m_count = 0;
+      m_is_valid = true;
+      return *this;
+    }
+
+    // false if a segment did not fit or had mismatched views
+    API_NO_DISCARD bool is_valid() const { return m_is_valid; }
+    API_NO_DISCARD size_t count() const { return m_count; }
+    API_NO_DISCARD const Segment *begin() const { return m_segments.data(); }
+    API_NO_DISCARD const Segment *end() const {
+      return m_segments.data() + m_count;
+    }
+
+  private:
+    var::Array<Segment, maximum_segment_count> m_segments;
+    size_t m_count = 0;
+    bool m_is_valid = true;
+
+    Transaction &push(const Segment &segment) {
+      if (m_count == maximum_segment_count) {
+        m_is_valid = false;
+        return *this;
+      }
+      m_segments.at(m_count++) = segment;
+      return *this;
+    }
+  };
+
   Spi(
     const var::StringView device,
     fs::OpenMode open_mode
@@ -109,32 +211,38 @@ public:
 
   Spi() = default;
 
-  Spi &set_attributes() { return ioctl(I_SPI_SETATTR); }
-  const Spi &set_attributes() const { return ioctl(I_SPI_SETATTR); }
+  Spi &set_attributes() {
+    return API_CONST_CAST_SELF(Spi, set_attributes);
+  }
+  const Spi &set_attributes() const {
+    invalidate_attribute_cache();
+    // the driver defaults are not known here
+    m_width = 0;
+    return ioctl(I_SPI_SETATTR);
+  }
 
   Spi &set_attributes(const Attributes &attributes) {
-    return ioctl(I_SPI_SETATTR, &attributes.m_attributes);
+    return API_CONST_CAST_SELF(Spi, set_attributes, attributes);
   }
 
   const Spi &set_attributes(const Attributes &attributes) const {
-    return ioctl(I_SPI_SETATTR, &attributes.m_attributes);
+    apply_attributes(I_SPI_SETATTR, attributes.m_attributes);
+    m_width = DeviceObject::is_success() ? attributes.width() : 0;
+    return *this;
   }
 
-  Spi &assert_cs() {
-    return set_attributes(Attributes().set_flags(Flags::assert_cs));
-  }
+  // chip select does not change the cached configuration
+  Spi &assert_cs() { return API_CONST_CAST_SELF(Spi, assert_cs); }
+  const Spi &assert_cs() const;
 
-  const Spi &assert_cs() const {
-    return set_attributes(Attributes().set_flags(Flags::assert_cs));
-  }
+  Spi &deassert_cs() { return API_CONST_CAST_SELF(Spi, deassert_cs); }
+  const Spi &deassert_cs() const;
 
-  Spi &deassert_cs() {
-    return set_attributes(Attributes().set_flags(Flags::deassert_cs));
-  }
-
-  const Spi &deassert_cs() const {
-    return set_attributes(Attributes().set_flags(Flags::deassert_cs));
+  // chip select is released if a segment fails while it is asserted
+  Spi &execute(const Transaction &transaction) {
+    return API_CONST_CAST_SELF(Spi, execute, transaction);
   }
+  const Spi &execute(const Transaction &transaction) const;
 
   API_NO_DISCARD Info get_info() {
     spi_info_t info;
@@ -144,7 +252,49 @@ public:
 
   Spi &swap(u32 value) { return ioctl(I_SPI_SWAP, MCU_INT_CAST(value)); }
 
+  // exchanges count words in one full duplex transfer with frames of
+  // `width` bits; zero uses width() from the last set_attributes(), and
+  // fails with EINVAL if that is not known either. Frames narrower than
+  // the word go most significant frame first through a staging buffer that
+  // is kept for the next call; frames as wide as the word move as is.
+  Spi &swap(const u16 *source, u16 *destination, size_t count, u8 width = 0) {
+    return API_CONST_CAST_SELF(Spi, swap, source, destination, count, width);
+  }
+  const Spi &
+  swap(const u16 *source, u16 *destination, size_t count, u8 width = 0) const;
+
+  Spi &swap(const u32 *source, u32 *destination, size_t count, u8 width = 0) {
+    return API_CONST_CAST_SELF(Spi, swap, source, destination, count, width);
+  }
+  const Spi &
+  swap(const u32 *source, u32 *destination, size_t count, u8 width = 0) const;
+
+  // zero until set_attributes() is given explicit attributes; the driver
+  // cannot report it
+  API_NO_DISCARD u8 width() const { return m_width; }
+
 private:
+  mutable u8 m_width = 0;
+  mutable var::Data m_swap_buffer;
+
+  void execute_segment(const Transaction::Segment &segment) const;
+#if defined __link
+  void swap_frames(
+    const Transaction::Segment &segment,
+    size_t size_of_frame) const;
+#endif
+  const Spi &exchange(
+    const void *source,
+    void *destination,
+    u32 size,
+    size_t size_of_frame) const;
+
+  template <typename Word>
+  const Spi &swap_words(
+    const Word *source,
+    Word *destination,
+    size_t count,
+    u8 width) const;
 };
 
 } // namespace hal
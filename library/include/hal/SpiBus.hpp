@@ -0,0 +1,140 @@
+// Copyright 2020-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#ifndef HALAPI_HAL_SPI_BUS_HPP_
+#define HALAPI_HAL_SPI_BUS_HPP_
+
+#include <thread/Cond.hpp>
+#include <thread/Mutex.hpp>
+#include <thread/Thread.hpp>
+#include <var/Array.hpp>
+
+#include "Spi.hpp"
+
+namespace hal {
+
+/*! \details
+ *
+ * Shares one SPI peripheral between several client devices. Each client
+ * registers the attributes it needs (mode, frequency, width and cs pin)
+ * and gets back an index. Threads take the bus in the order they asked
+ * for it, and the attributes are only written when the bus moves to a
+ * different client.
+ *
+ * ```cpp
+ * SpiBus bus("/dev/spi0");
+ * const auto sensor = bus.add_client(sensor_attributes);
+ * const auto display = bus.add_client(display_attributes);
+ *
+ * bus.execute(sensor, read_sample);
+ *
+ * // one turn on the bus for both clients
+ * bus.execute(SpiBus::Batch()
+ *               .add(sensor, read_sample)
+ *               .add(display, write_line));
+ * ```
+ *
+ * Register clients before other threads use the bus. The bus is not
+ * reentrant: a thread that asks for it again while it holds it (a Guard
+ * inside a Guard, or execute() under a Guard) gets EDEADLK instead of
+ * waiting for itself.
+ *
+ */
+class SpiBus : public api::ExecutionContext {
+public:
+  static constexpr size_t maximum_client_count = 8;
+
+  // transactions run back to back in the order they were added; grouping
+  // them by client avoids reprogramming the bus between them
+  class Batch {
+  public:
+    static constexpr size_t maximum_count = 8;
+
+    Batch &add(size_t client, const Spi::Transaction &transaction) {
+      if (m_count == maximum_count) {
+        m_is_valid = false;
+        return *this;
+      }
+      m_entries.at(m_count++) = {client, &transaction};
+      return *this;
+    }
+
+    API_NO_DISCARD bool is_valid() const { return m_is_valid; }
+    API_NO_DISCARD size_t count() const { return m_count; }
+
+  private:
+    friend class SpiBus;
+    struct Entry {
+      size_t client;
+      const Spi::Transaction *transaction;
+    };
+
+    var::Array<Entry, maximum_count> m_entries;
+    size_t m_count = 0;
+    bool m_is_valid = true;
+  };
+
+  // holds the bus, configured for one client, until it goes out of scope
+  class Guard {
+  public:
+    Guard(SpiBus &bus, size_t client);
+    ~Guard();
+
+    Guard(const Guard &) = delete;
+    Guard &operator=(const Guard &) = delete;
+
+    API_NO_DISCARD const Spi &spi() const { return m_bus.m_spi; }
+
+  private:
+    SpiBus &m_bus;
+    bool m_is_acquired;
+  };
+
+  explicit SpiBus(
+    const var::StringView device,
+    fs::OpenMode open_mode
+    = DEVICE_OPEN_MODE FSAPI_LINK_DECLARE_DRIVER_NULLPTR_LAST);
+
+  SpiBus(const SpiBus &) = delete;
+  SpiBus &operator=(const SpiBus &) = delete;
+
+  // returns the client index used with execute() and Guard
+  size_t add_client(const Spi::Attributes &attributes);
+
+  // changes take effect the next time the client takes the bus
+  SpiBus &set_client(size_t client, const Spi::Attributes &attributes);
+
+  SpiBus &execute(size_t client, const Spi::Transaction &transaction);
+  SpiBus &execute(const Batch &batch);
+
+  API_NO_DISCARD size_t client_count() const { return m_client_count; }
+  // number of times the attributes were written
+  API_NO_DISCARD u32 reconfigure_count() const { return m_reconfigure_count; }
+
+private:
+  static constexpr size_t no_client = maximum_client_count;
+
+  Spi m_spi;
+  var::Array<Spi::Attributes, maximum_client_count> m_clients;
+  size_t m_client_count = 0;
+  size_t m_active_client = no_client;
+  u32 m_reconfigure_count = 0;
+
+  // tickets give the bus out in request order
+  thread::Mutex m_mutex;
+  thread::Cond m_cond{m_mutex};
+  u32 m_next_ticket = 0;
+  u32 m_serving_ticket = 0;
+  // the thread holding the bus, valid while m_is_owned
+  pthread_t m_owner{};
+  bool m_is_owned = false;
+
+  // false with EDEADLK if the calling thread already holds the bus
+  bool acquire();
+  void release();
+  // called with the bus held
+  void select(size_t client);
+};
+
+} // namespace hal
+
+#endif // HALAPI_HAL_SPI_BUS_HPP_
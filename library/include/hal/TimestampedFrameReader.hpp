@@ -0,0 +1,124 @@
+// Copyright 2020-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#ifndef HALAPI_HAL_TIMESTAMPED_FRAME_READER_HPP_
+#define HALAPI_HAL_TIMESTAMPED_FRAME_READER_HPP_
+
+#include <chrono/ClockTimer.hpp>
+
+#include "FrameBufferReader.hpp"
+#include "FrameStream.hpp"
+
+namespace hal {
+
+/*! \details
+ *
+ * Reads received FrameStream frames with a FrameBufferReader and gives each
+ * one a sequence number and a capture time. The stream driver counts every
+ * frame it fills (`access_count`). After each read that count, minus the
+ * frames still waiting, gives the sequence of the frames just read. A jump
+ * forward in the sequence means frames were dropped. A step back (the
+ * stream was restarted or flushed) starts counting again without a gap.
+ *
+ * Capture times are estimated: the newest frame is taken to have finished
+ * when get_info() is sampled, and older frames are spaced by the frame
+ * period measured from successive samples. The spread of those
+ * measurements is reported as jitter. Times are in microseconds since the
+ * reader was created.
+ *
+ */
+class TimestampedFrameReader : public api::ExecutionContext {
+public:
+  class Frame {
+    API_AC(Frame, var::View, view);
+    API_AF(Frame, u32, sequence, 0);
+    API_AC(Frame, chrono::MicroTime, timestamp);
+  };
+
+  class Statistics {
+    API_AF(Statistics, u32, frame_count, 0);
+    // times the sequence jumped and the frames lost in the jumps
+    API_AF(Statistics, u32, gap_count, 0);
+    API_AF(Statistics, u32, dropped_count, 0);
+    API_AC(Statistics, chrono::MicroTime, period);
+    API_AC(Statistics, chrono::MicroTime, jitter);
+    API_AC(Statistics, chrono::MicroTime, maximum_jitter);
+  };
+
+  class Frames {
+  public:
+    class Iterator {
+    public:
+      Iterator(const Frames *frames, u32 offset)
+        : m_frames(frames), m_offset(offset) {}
+      Frame operator*() const { return m_frames->at(m_offset); }
+      Iterator &operator++() {
+        m_offset++;
+        return *this;
+      }
+      bool operator!=(const Iterator &a) const {
+        return m_offset != a.m_offset;
+      }
+
+    private:
+      const Frames *m_frames;
+      u32 m_offset;
+    };
+
+    API_NO_DISCARD Iterator begin() const { return Iterator(this, 0); }
+    API_NO_DISCARD Iterator end() const { return Iterator(this, count()); }
+    API_NO_DISCARD u32 count() const { return m_frames.count(); }
+    API_NO_DISCARD bool is_empty() const { return m_frames.is_empty(); }
+
+    API_NO_DISCARD Frame at(u32 offset) const {
+      // the last frame finished at m_timestamp
+      const auto age = chrono::MicroTime(
+        u64(m_period.microseconds()) * (count() - 1 - offset));
+      return Frame()
+        .set_view(m_frames.at(offset))
+        .set_sequence(m_sequence + offset)
+        .set_timestamp(
+          m_timestamp > age ? m_timestamp - age : chrono::MicroTime());
+    }
+
+  private:
+    friend class TimestampedFrameReader;
+    FrameBufferReader::Frames m_frames;
+    u32 m_sequence = 0;
+    chrono::MicroTime m_timestamp;
+    chrono::MicroTime m_period;
+  };
+
+  // a frame_count of zero makes room for the whole receive fifo
+  explicit TimestampedFrameReader(
+    const FrameStream &stream,
+    u32 frame_count = 0);
+
+  TimestampedFrameReader(const TimestampedFrameReader &) = delete;
+  TimestampedFrameReader &operator=(const TimestampedFrameReader &) = delete;
+
+  // frames are valid until the next read()
+  const Frames &read();
+
+  API_NO_DISCARD const Frames &frames() const { return m_frames; }
+  API_NO_DISCARD const Statistics &statistics() const { return m_statistics; }
+
+private:
+  const FrameStream &m_stream;
+  chrono::ClockTimer m_timer;
+  FrameBufferReader m_reader;
+  Frames m_frames;
+  Statistics m_statistics;
+
+  bool m_is_sequence_valid = false;
+  u32 m_next_sequence = 0;
+  // previous get_info() sample, for the period
+  bool m_is_sample_valid = false;
+  u32 m_sample_access_count = 0;
+  chrono::MicroTime m_sample_time;
+
+  void update_period(u32 access_count, const chrono::MicroTime &now);
+};
+
+} // namespace hal
+
+#endif // HALAPI_HAL_TIMESTAMPED_FRAME_READER_HPP_
@@ -32,6 +32,8 @@ public:
   class Attributes {
   public:
     Attributes() {
+      // AttributeCache compares the padding too
+      var::View(m_attributes).fill<u8>(0);
       set_flags(Flags::set_line_coding_default);
       set_frequency(115200);
       set_width(8);
@@ -112,15 +114,20 @@ public:
     return ioctl(I_UART_GETVERSION).return_value();
   }
 
-  Uart &set_attributes() { return ioctl(I_UART_SETATTR); }
-  const Uart &set_attributes() const { return ioctl(I_UART_SETATTR); }
+  Uart &set_attributes() {
+    return API_CONST_CAST_SELF(Uart, set_attributes);
+  }
+  const Uart &set_attributes() const {
+    invalidate_attribute_cache();
+    return ioctl(I_UART_SETATTR);
+  }
 
   Uart &set_attributes(const Attributes &attr) {
-    return ioctl(I_UART_SETATTR, (void *)&attr.m_attributes);
+    return API_CONST_CAST_SELF(Uart, set_attributes, attr);
   }
 
   const Uart &set_attributes(const Attributes &attr) const {
-    return ioctl(I_UART_SETATTR, (void *)&attr.m_attributes);
+    return apply_attributes(I_UART_SETATTR, attr.m_attributes);
   }
 
   Uart &put(char c) { return ioctl(I_UART_PUT, &c); }
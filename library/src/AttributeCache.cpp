@@ -0,0 +1,96 @@
+// Copyright 2020-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#include <cstring>
+
+#include "hal/AttributeCache.hpp"
+
+using namespace hal;
+
+u32 AttributeCache::key(var::StringView path) {
+  // FNV-1a
+  u32 result = 2166136261UL;
+  for (size_t i = 0; i < path.length(); i++) {
+    result = (result ^ u8(path.data()[i])) * 16777619UL;
+  }
+  return result ? result : 1;
+}
+
+bool AttributeCache::is_current(
+  u32 key,
+  int request,
+  var::View attributes) const {
+  const auto *entry = find(key, request);
+  const auto result = entry != nullptr && entry->size == attributes.size()
+                      && ::memcmp(
+                           entry->attributes.data(),
+                           attributes.to_const_void(),
+                           attributes.size())
+                           == 0;
+  if (result) {
+    m_hit_count++;
+  } else {
+    m_miss_count++;
+  }
+  return result;
+}
+
+AttributeCache &
+AttributeCache::update(u32 key, int request, var::View attributes) {
+  if (attributes.size() > attributes_size) {
+    // too big to remember -- make sure a stale copy is not used
+    for (auto &entry : m_entries) {
+      if (entry.key == key && entry.request == request) {
+        entry = Entry();
+      }
+    }
+    return *this;
+  }
+
+  auto *entry = const_cast<Entry *>(find(key, request));
+  if (entry == nullptr) {
+    for (auto &candidate : m_entries) {
+      if (candidate.key == 0) {
+        entry = &candidate;
+        break;
+      }
+    }
+  }
+
+  if (entry == nullptr) {
+    entry = &m_entries.at(m_next_eviction);
+    m_next_eviction = (m_next_eviction + 1) % entry_count;
+  }
+
+  entry->key = key;
+  entry->request = request;
+  entry->size = attributes.size();
+  ::memcpy(
+    entry->attributes.data(),
+    attributes.to_const_void(),
+    attributes.size());
+  return *this;
+}
+
+AttributeCache &AttributeCache::invalidate(u32 key) {
+  for (auto &entry : m_entries) {
+    if (entry.key == key) {
+      entry = Entry();
+    }
+  }
+  return *this;
+}
+
+AttributeCache &AttributeCache::invalidate() {
+  m_entries = var::Array<Entry, entry_count>();
+  return *this;
+}
+
+const AttributeCache::Entry *
+AttributeCache::find(u32 key, int request) const {
+  for (const auto &entry : m_entries) {
+    if (entry.key != 0 && entry.key == key && entry.request == request) {
+      return &entry;
+    }
+  }
+  return nullptr;
+}
@@ -0,0 +1,67 @@
+// Copyright 2020-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#include <algorithm>
+
+#include "hal/BufferMap.hpp"
+
+using namespace hal;
+
+BufferMap::BufferMap(
+  const DeviceObject::DeviceFile &file,
+  size_t fallback_size)
+  : m_file(&file) {
+  m_fallback.resize(fallback_size);
+}
+
+BufferMap::Region BufferMap::acquire() {
+  API_RETURN_VALUE_IF_ERROR(Region());
+  return is_mapped() ? acquire_mapped() : acquire_fallback();
+}
+
+BufferMap &BufferMap::release(size_t size) {
+  API_RETURN_VALUE_IF_ERROR(*this);
+  if (is_mapped()) {
+    API_SYSTEM_CALL("consume", m_mapping->consume(size));
+    return *this;
+  }
+  m_fallback_offset = std::min(m_fallback_offset + size, m_fallback_count);
+  return *this;
+}
+
+BufferMap::Region BufferMap::acquire_mapped() {
+  if (!m_mapping->is_writeblock()) {
+    API_RETURN_VALUE_ASSIGN_ERROR(
+      Region(),
+      "mapping requires writeblock",
+      EINVAL);
+  }
+  return m_mapping->map();
+}
+
+BufferMap::Region BufferMap::acquire_fallback() {
+  if (m_fallback_offset == m_fallback_count) {
+    m_fallback_offset = m_fallback_count = 0;
+    int result = 0;
+    int error_number = 0;
+    {
+      api::ErrorScope error_scope;
+      result = m_file->read(m_fallback).return_value();
+      error_number = is_error() ? error().error_number() : 0;
+    }
+
+    if (error_number == EAGAIN) {
+      return Region();
+    }
+
+    if (error_number != 0) {
+      API_RETURN_VALUE_ASSIGN_ERROR(Region(), "read failed", error_number);
+    }
+    m_fallback_count = result;
+  }
+
+  return Region(
+    var::View(
+      m_fallback.data_u8() + m_fallback_offset,
+      m_fallback_count - m_fallback_offset),
+    var::View());
+}
@@ -4,9 +4,53 @@
 #include <var/StackString.hpp>
 
 #include "hal/ByteBuffer.hpp"
+#include "hal/SignalWait.hpp"
 
 using namespace hal;
 
+#if !defined __link
+ByteBuffer::Info ByteBuffer::wait_ready(const Watermark &options) const {
+  API_RETURN_VALUE_IF_ERROR(Info());
+  auto result = get_info();
+  if (DeviceObject::is_error() || result.size_ready() >= options.size()) {
+    return result;
+  }
+
+  const DeviceSignal signal(
+    DeviceSignal::IsPersistent::yes,
+    options.signal_number(),
+    0);
+  const SignalWait signal_wait(options.signal_number());
+  API_RETURN_VALUE_IF_ERROR(result);
+
+  set_signal_action(
+    signal,
+    DeviceSignal::CreateAction().set_o_events(MCU_EVENT_FLAG_DATA_READY));
+
+  chrono::ClockTimer timer;
+  timer.start();
+  while (DeviceObject::is_success()) {
+    // checked after the action is set so no event can be missed
+    result = get_info();
+    if (DeviceObject::is_error() || result.size_ready() >= options.size()) {
+      break;
+    }
+    if (!signal_wait.wait(timer, options.timeout())) {
+      // report what arrived up to the deadline
+      result = get_info();
+      break;
+    }
+  }
+
+  {
+    api::ErrorScope error_scope;
+    mcu_action_t action = {.o_events = MCU_EVENT_FLAG_DATA_READY};
+    ioctl(I_MCU_SETACTION, &action);
+  }
+  return result;
+}
+#endif
+
 printer::Printer &printer::operator<<(
   printer::Printer &printer,
   const hal::ByteBuffer::Attributes &a) {
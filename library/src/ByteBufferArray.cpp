@@ -1,89 +1,79 @@
-/*! \file */ // Copyright 2011-2020 Tyler Gilbert and Stratify Labs, Inc; see
-             // LICENSE.md for rights.
+// Copyright 2020-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
 
-#include "hal/CFifo.hpp"
-#include "hal/Fifo.hpp"
+#include <algorithm>
 
-namespace hal {
+#include "hal/ByteBufferArray.hpp"
 
-int CFifo::get_count() const {
-  cfifo_info_t info;
-  if (get_info(info) < 0) {
-    return -1;
-  }
-  return info.count;
-}
-
-int CFifo::get_info(cfifo_info_t &info) const {
-  return ioctl(IoRequest(I_CFIFO_GETINFO), IoArgument(&info));
-}
+using namespace hal;
 
-int CFifo::get_owner(int channel, int &owner) const {
-  mcu_channel_t c;
-  int ret;
-  c.loc = channel;
-  c.value = static_cast<u32>(-1);
-  ret = ioctl(IoRequest(I_CFIFO_GETOWNER), IoArgument(&c));
-  if (ret >= 0) {
-    owner = c.value;
-  }
-  return ret;
+ByteBufferArray::Info ByteBufferArray::get_info() const {
+  cfifo_info_t info = {};
+  ioctl(I_CFIFO_GETINFO, &info);
+  return Info(info);
 }
 
-int CFifo::set_owner(int channel, int owner) const {
-  mcu_channel_t c;
-  c.loc = channel;
-  c.value = owner;
-  return ioctl(IoRequest(I_CFIFO_SETOWNER), IoArgument(&c));
-}
-
-int CFifo::get_info(int channel, fifo_info_t &info) const {
-  cfifo_fifoinfo_t fifo_info;
+ByteBuffer::Info ByteBufferArray::get_info(u32 channel) const {
+  cfifo_fifoinfo_t fifo_info = {};
   fifo_info.channel = channel;
-  if (ioctl(IoRequest(I_CFIFO_FIFOGETINFO), IoArgument(&fifo_info)) >= 0) {
-    info = fifo_info.info;
-  }
-  return 0;
+  ioctl(I_CFIFO_FIFOGETINFO, &fifo_info);
+  return ByteBuffer::Info(fifo_info.info);
 }
 
-FifoInfo CFifo::get_info(int channel) {
-  FifoInfo info;
-  get_info(channel, info.m_info);
-  return info;
-}
+ByteBufferArray::ChannelInfo ByteBufferArray::get_channel_info() const {
+  ChannelInfo result;
+  result.m_info = get_info();
+  API_RETURN_VALUE_IF_ERROR(result);
 
-int CFifo::set_attributes(int channel, const fifo_attr_t &attr) const {
-  cfifo_fifoattr_t fifo_attr;
-  fifo_attr.channel = channel;
-  fifo_attr.attr = attr;
-  return ioctl(IoRequest(I_CFIFO_FIFOSETATTR), IoArgument(&fifo_attr));
+  const u32 count = std::min(result.count(), maximum_channel_count);
+  for (u32 channel = 0; channel < count; channel++) {
+    result.m_size_ready.at(channel) = 0;
+    if (result.m_info.is_ready(channel)) {
+      const auto info = get_info(channel);
+      API_RETURN_VALUE_IF_ERROR(result);
+      result.m_size_ready.at(channel) = info.size_ready();
+      if (info.is_overflow()) {
+        result.m_o_overflow |= 1UL << channel;
+      }
+    }
+  }
+  return result;
 }
 
-int CFifo::initialize(int channel) const {
-  cfifo_fiforequest_t request;
-  request.channel = channel;
-  return ioctl(IoRequest(I_CFIFO_FIFOINIT), IoArgument(&request));
+int ByteBufferArray::get_owner(u32 channel) const {
+  mcu_channel_t owner = {.loc = channel, .value = u32(-1)};
+  ioctl(I_CFIFO_GETOWNER, &owner);
+  return int(owner.value);
 }
 
-int CFifo::flush(int channel) const {
-  cfifo_fiforequest_t request;
-  request.channel = channel;
-  return ioctl(IoRequest(I_CFIFO_FIFOFLUSH), IoArgument(&request));
+const ByteBufferArray &
+ByteBufferArray::set_owner(u32 channel, int owner) const {
+  mcu_channel_t value = {.loc = channel, .value = u32(owner)};
+  return ioctl(I_CFIFO_SETOWNER, &value);
 }
 
-int CFifo::exit(int channel) const {
-  cfifo_fiforequest_t request = {0};
-  request.channel = channel;
-  return ioctl(IoRequest(I_CFIFO_FIFOEXIT), IoArgument(&request));
+const ByteBufferArray &ByteBufferArray::set_attributes(
+  u32 channel,
+  const ByteBuffer::Attributes &attributes) const {
+  cfifo_fifoattr_t fifo_attributes = {};
+  fifo_attributes.channel = channel;
+  fifo_attributes.attr = *attributes.attributes();
+  return ioctl(I_CFIFO_FIFOSETATTR, &fifo_attributes);
 }
 
-int CFifo::set_writeblock(int channel, bool value) const {
-  fifo_attr_t attr = {0};
-  attr.o_flags = FifoFlags::flag_set_writeblock;
-  if (value == false) {
-    attr.o_flags |= FifoFlags::flag_is_overflow;
+const ByteBufferArray &
+ByteBufferArray::set_writeblock(u32 channel, bool value) const {
+  // the driver clears writeblock when both flags are set
+  ByteBuffer::Attributes attributes;
+  attributes.set_writeblock();
+  if (!value) {
+    attributes.set_overflow();
   }
-  return set_attributes(channel, attr);
+  return set_attributes(channel, attributes);
 }
 
-} /* namespace hal */
+const ByteBufferArray &
+ByteBufferArray::channel_request(int request, u32 channel) const {
+  cfifo_fiforequest_t fifo_request = {};
+  fifo_request.channel = channel;
+  return ioctl(request, &fifo_request);
+}
@@ -1,10 +1,41 @@
 // Copyright 2020-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
 
+#include <algorithm>
+
+#include <chrono/ClockTimer.hpp>
+
 #include "hal/Device.hpp"
 
 using namespace hal;
 using namespace chrono;
 
+size_t DeviceObject::scatter_read_implementation(
+  const DeviceFile &file,
+  const ViewSpan &views) {
+  size_t total = 0;
+  for (const auto &view : views) {
+    API_RETURN_VALUE_IF_ERROR(total);
+    const auto result = file.read(view).return_value();
+    if (result > 0) {
+      total += result;
+    }
+    if (result < int(view.size())) {
+      // the device has no more data ready
+      return total;
+    }
+  }
+  return total;
+}
+
+void DeviceObject::gather_write_implementation(
+  const DeviceFile &file,
+  const ViewSpan &views) {
+  for (const auto &view : views) {
+    API_RETURN_IF_ERROR();
+    file.write(view);
+  }
+}
+
 #ifndef __link
 void DeviceObject::read_implementation(const DeviceFile &file, fs::Aio &aio) {
   API_RETURN_IF_ERROR();
@@ -18,6 +49,10 @@ void DeviceObject::write_implementation(const DeviceFile &file, fs::Aio &aio) {
   API_SYSTEM_CALL("", ::aio_write(&(aio.m_aio_var)));
 }
 
+int DeviceObject::return_value_implementation(fs::Aio &aio) {
+  return ::aio_return(&(aio.m_aio_var));
+}
+
 void DeviceObject::cancel_read_implementation(
   const DeviceFile &file,
   int channel) {
@@ -44,10 +79,145 @@ void DeviceObject::transfer_implementation(
   fs::Aio aio(options.destination());
   read_implementation(file, aio);
   file.write(options.source());
+
+  const auto is_complete = options.completion() == Completion::suspend
+                             ? suspend_implementation(aio, options.timeout())
+                             : poll_implementation(aio, options.timeout());
+
+  if (!is_complete) {
+    const auto is_timeout = is_success();
+    {
+      // the cancel must be issued even if the context is in error
+      api::ErrorScope error_scope;
+      cancel_read_implementation(file);
+      while (aio.is_busy()) {
+        // aio must live until the read completes -- or big problems
+        wait(200_microseconds);
+      }
+    }
+    if (is_timeout) {
+      API_RETURN_ASSIGN_ERROR("transfer timed out", ETIMEDOUT);
+    }
+  }
+}
+
+void DeviceObject::transfer_implementation(
+  const DeviceFile &file,
+  const ScatterTransfer &options) {
+  if (options.source().size() != options.destination().size()) {
+    API_RETURN_ASSIGN_ERROR("scatter transfer size mismatch", EINVAL);
+  }
+
+  ClockTimer timer;
+  timer.start();
+
+  // each chunk ends at the next source or destination view boundary
+  auto source = options.source().begin();
+  auto destination = options.destination().begin();
+  size_t source_offset = 0;
+  size_t destination_offset = 0;
+  while (source != options.source().end()
+         && destination != options.destination().end()) {
+    API_RETURN_IF_ERROR();
+    const auto size = std::min(
+      source->size() - source_offset,
+      destination->size() - destination_offset);
+
+    if (size) {
+      // each chunk gets what is left of the deadline
+      auto timeout = MicroTime();
+      if (options.timeout() != MicroTime()) {
+        const auto elapsed = timer.micro_time();
+        if (elapsed >= options.timeout()) {
+          API_RETURN_ASSIGN_ERROR("transfer timed out", ETIMEDOUT);
+        }
+        timeout = options.timeout() - elapsed;
+      }
+      transfer_implementation(
+        file,
+        Transfer()
+          .set_source(
+            var::View(source->to_const_u8() + source_offset, size))
+          .set_destination(
+            var::View(destination->to_u8() + destination_offset, size))
+          .set_completion(options.completion())
+          .set_timeout(timeout));
+    }
+
+    source_offset += size;
+    destination_offset += size;
+    if (source_offset == source->size()) {
+      ++source;
+      source_offset = 0;
+    }
+    if (destination_offset == destination->size()) {
+      ++destination;
+      destination_offset = 0;
+    }
+  }
+}
+
+bool DeviceObject::poll_implementation(
+  const fs::Aio &aio,
+  const chrono::MicroTime &timeout) {
+  ClockTimer timer;
+  timer.start();
   while (aio.is_busy() && is_success()) {
-    // aio must live until the read completes -- or big problems will happen
+    if (timeout != MicroTime() && timer.micro_time() >= timeout) {
+      return false;
+    }
     wait(200_microseconds);
   }
+  // false if an error stopped the wait with the request still in flight
+  return !aio.is_busy();
+}
+
+bool DeviceObject::suspend_implementation(
+  fs::Aio &aio,
+  const chrono::MicroTime &timeout) {
+  const struct aiocb *const list[] = {&aio.m_aio_var};
+  const auto is_deadline = timeout != MicroTime();
+  ClockTimer timer;
+  timer.start();
+  while (aio.is_busy() && is_success()) {
+    struct timespec remaining = {};
+    if (is_deadline) {
+      const auto elapsed = timer.micro_time();
+      if (elapsed >= timeout) {
+        return false;
+      }
+      const auto left = timeout - elapsed;
+      remaining.tv_sec = time_t(left.seconds());
+      remaining.tv_nsec = long((left.microseconds() % 1000000UL) * 1000UL);
+    }
+
+    // EAGAIN (deadline) and EINTR (signal) are re-checked by the loop
+    const auto result
+      = ::aio_suspend(list, 1, is_deadline ? &remaining : nullptr);
+    if (result < 0 && errno != EAGAIN && errno != EINTR) {
+      API_SYSTEM_CALL("", result);
+    }
+  }
+  return !aio.is_busy();
+}
+
+void DeviceObject::suspend_implementation(
+  const struct aiocb *const *list,
+  size_t count) {
+  API_RETURN_IF_ERROR();
+  if (count == 0) {
+    return;
+  }
+  for (size_t i = 0; i < count; i++) {
+    if (::aio_error(list[i]) != EINPROGRESS) {
+      return;
+    }
+  }
+
+  const auto result = ::aio_suspend(list, count, nullptr);
+  if (result < 0 && errno != EINTR) {
+    API_SYSTEM_CALL("", result);
+  }
 }
 
 void DeviceObject::set_interrupt_priority_implementation(
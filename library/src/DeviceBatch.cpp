@@ -0,0 +1,152 @@
+// Copyright 2020-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#include <algorithm>
+
+#include <printer/Printer.hpp>
+#include <var/StackString.hpp>
+
+#include "hal/DeviceBatch.hpp"
+
+using namespace hal;
+
+printer::Printer &printer::operator<<(
+  printer::Printer &printer,
+  const hal::DeviceBatch::Operation &a) {
+  const auto type = [&]() {
+    switch (a.type()) {
+    case hal::DeviceBatch::Type::ioctl:
+      return "ioctl";
+    case hal::DeviceBatch::Type::read:
+      return "read";
+    case hal::DeviceBatch::Type::write:
+      return "write";
+    }
+    return "unknown";
+  }();
+
+  printer.key("type", type);
+  if (a.type() == hal::DeviceBatch::Type::ioctl) {
+    printer.key("request", var::NumberString(a.request(), "0x%08X"));
+  } else {
+    printer.key("size", var::NumberString(a.view().size()));
+  }
+  return printer.key_bool("submitted", a.is_submitted())
+    .key("returnValue", var::NumberString(a.return_value()))
+    .key("errorNumber", var::NumberString(a.error_number()));
+}
+
+printer::Printer &
+printer::operator<<(printer::Printer &printer, const hal::DeviceBatch &a) {
+  printer.key("count", var::NumberString(a.count()))
+    .key("errorCount", var::NumberString(a.error_count()));
+  int offset = 0;
+  for (const auto &operation : a.operations()) {
+    printer.object(var::NumberString(offset++), operation);
+  }
+  return printer;
+}
+
+DeviceBatch &DeviceBatch::submit(
+  const DeviceObject::DeviceFile &file,
+  IsStopOnError is_stop_on_error) {
+  API_RETURN_VALUE_IF_ERROR(*this);
+  for (auto &operation : m_operations) {
+    operation.set_submitted(false).set_return_value(0).set_error_number(0);
+  }
+
+  size_t offset = 0;
+  while (offset < m_operations.count()) {
+    const auto count = submit_run(file, offset);
+    bool is_failed = false;
+    for (size_t i = offset; i < offset + count; i++) {
+      is_failed = is_failed || m_operations.at(i).error_number() != 0;
+    }
+    offset += count;
+    if (is_stop_on_error == IsStopOnError::yes && is_failed) {
+      break;
+    }
+  }
+  return *this;
+}
+
+size_t DeviceBatch::submit_run(
+  const DeviceObject::DeviceFile &file,
+  size_t offset) {
+  const auto type = m_operations.at(offset).type();
+  const auto *begin = m_operations.at(offset).view().to_const_u8();
+  size_t end = offset + 1;
+  size_t size = m_operations.at(offset).view().size();
+  if (is_coalesce() && type != Type::ioctl) {
+    // only views that already form one buffer, so nothing is copied
+    while (
+      end < m_operations.count() && m_operations.at(end).type() == type
+      && m_operations.at(end).view().to_const_u8() == begin + size) {
+      size += m_operations.at(end).view().size();
+      end++;
+    }
+  }
+
+  if (end - offset == 1) {
+    submit_one(file, m_operations.at(offset));
+    return 1;
+  }
+
+  const auto &first = m_operations.at(offset).view();
+  int return_value;
+  int error_number;
+  {
+    // one error context for the run; every operation in it reports it
+    api::ErrorScope error_scope;
+    return_value
+      = type == Type::write
+          ? file.write(var::View(first.to_const_void(), size)).return_value()
+          : file.read(var::View(first.to_void(), size)).return_value();
+    error_number = is_error() ? error().error_number() : 0;
+  }
+
+  // bytes are handed out in order, so a short transfer fills the front
+  size_t remaining = return_value > 0 ? return_value : 0;
+  for (size_t i = offset; i < end; i++) {
+    auto &operation = m_operations.at(i);
+    const auto count = std::min(remaining, operation.view().size());
+    remaining -= count;
+    operation.set_submitted()
+      .set_return_value(error_number ? return_value : int(count))
+      .set_error_number(error_number);
+  }
+  return end - offset;
+}
+
+void DeviceBatch::submit_one(
+  const DeviceObject::DeviceFile &file,
+  Operation &operation) {
+  // each operation gets its own error context so one failure
+  // is reported against that operation only
+  api::ErrorScope error_scope;
+  const auto return_value = [&]() {
+    switch (operation.type()) {
+    case Type::ioctl:
+      return file.ioctl(operation.request(), operation.argument())
+        .return_value();
+    case Type::read:
+      return file.read(operation.view()).return_value();
+    case Type::write:
+      return file.write(operation.view()).return_value();
+    }
+    return -1;
+  }();
+
+  operation.set_submitted()
+    .set_return_value(return_value)
+    .set_error_number(is_error() ? error().error_number() : 0);
+}
+
+size_t DeviceBatch::error_count() const {
+  size_t result = 0;
+  for (const auto &operation : m_operations) {
+    if (operation.is_submitted() && !operation.is_success()) {
+      result++;
+    }
+  }
+  return result;
+}
@@ -0,0 +1,164 @@
+// Copyright 2020-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#if !defined __link && defined __cpp_impl_coroutine
+
+#include "hal/DeviceExecutor.hpp"
+
+using namespace hal;
+
+bool DeviceObject::Awaitable::start(
+  DeviceExecutor *executor,
+  std::coroutine_handle<> handle) {
+  // returning false resumes the task at once and await_resume() fails
+  API_RETURN_VALUE_IF_ERROR(false);
+  if (executor == nullptr) {
+    API_RETURN_VALUE_ASSIGN_ERROR(false, "no executor", EINVAL);
+  }
+
+  // the errno is kept here; the context may be reset before the task
+  // resumes
+  {
+    api::ErrorScope error_scope;
+    if (m_type == Type::write) {
+      write_implementation(*m_file, m_aio);
+    } else {
+      read_implementation(*m_file, m_aio);
+    }
+    m_error_number = is_error() ? error().error_number() : 0;
+  }
+  if (m_error_number) {
+    return false;
+  }
+
+  if (m_type == Type::transfer) {
+    {
+      api::ErrorScope error_scope;
+      m_file->write(m_source);
+      m_error_number = is_error() ? error().error_number() : 0;
+    }
+    if (m_error_number) {
+      // the read must still complete before m_aio goes away
+      api::ErrorScope error_scope;
+      cancel_read_implementation(*m_file);
+    }
+  }
+
+  executor->add_pending(*m_file, m_aio, m_type == Type::write, handle);
+  return true;
+}
+
+int DeviceObject::Awaitable::await_resume() {
+  API_RETURN_VALUE_IF_ERROR(-1);
+  if (m_error_number) {
+    API_RETURN_VALUE_ASSIGN_ERROR(-1, "aio submit", m_error_number);
+  }
+  const int result = return_value_implementation(m_aio);
+  if (result < 0) {
+    API_RETURN_VALUE_ASSIGN_ERROR(
+      result,
+      "aio",
+      ::aio_error(&(m_aio.m_aio_var)));
+  }
+  return result;
+}
+
+DeviceExecutor &DeviceExecutor::spawn(DeviceTask &&task) {
+  API_RETURN_VALUE_IF_ERROR(*this);
+  if (!task.is_valid()) {
+    API_RETURN_VALUE_ASSIGN_ERROR(*this, "invalid task", EINVAL);
+  }
+  // the executor owns the frame from here on
+  auto handle = task.m_handle;
+  task.m_handle = {};
+  handle.promise().m_executor = this;
+  m_tasks.push_back(handle);
+  m_ready.push_back(handle);
+  return *this;
+}
+
+DeviceExecutor &DeviceExecutor::run() {
+  API_RETURN_VALUE_IF_ERROR(*this);
+  while (m_ready.count() || m_pending.count()) {
+    resume_ready();
+    if (m_pending.count() == 0) {
+      continue;
+    }
+
+    m_wait_list.clear();
+    for (const auto &pending : m_pending) {
+      m_wait_list.push_back(
+        DeviceObject::control_block_implementation(*pending.aio));
+    }
+    // an error left by a task must not stop the wait
+    int error_number = 0;
+    {
+      api::ErrorScope error_scope;
+      DeviceObject::suspend_implementation(
+        &m_wait_list.at(0),
+        m_wait_list.count());
+      error_number = is_error() ? error().error_number() : 0;
+    }
+    if (error_number) {
+      // the frames own the aiocbs the driver is still writing
+      cancel_pending();
+      destroy_tasks();
+      API_RETURN_VALUE_ASSIGN_ERROR(*this, "aio_suspend", error_number);
+    }
+    collect_completed();
+  }
+
+  destroy_tasks();
+  return *this;
+}
+
+void DeviceExecutor::cancel_pending() {
+  api::ErrorScope error_scope;
+  for (const auto &pending : m_pending) {
+    if (pending.is_write) {
+      DeviceObject::cancel_write_implementation(*pending.file);
+    } else {
+      DeviceObject::cancel_read_implementation(*pending.file);
+    }
+  }
+  for (const auto &pending : m_pending) {
+    // aio must live until the driver lets go -- or big problems
+    while (pending.aio->is_busy()) {
+      chrono::wait(chrono::MicroTime(200));
+    }
+  }
+  m_pending.clear();
+  m_ready.clear();
+}
+
+void DeviceExecutor::destroy_tasks() {
+  for (auto handle : m_tasks) {
+    handle.destroy();
+  }
+  m_tasks.clear();
+}
+
+void DeviceExecutor::resume_ready() {
+  // a resumed task may spawn another, so count() is re-read each pass
+  for (size_t i = 0; i < m_ready.count(); i++) {
+    const auto handle = m_ready.at(i);
+    // the context is per thread; a task only sees the errors it causes
+    api::ErrorScope error_scope;
+    handle.resume();
+  }
+  m_ready.clear();
+}
+
+void DeviceExecutor::collect_completed() {
+  size_t i = 0;
+  while (i < m_pending.count()) {
+    const auto &pending = m_pending.at(i);
+    if (pending.aio->is_busy()) {
+      i++;
+    } else {
+      m_ready.push_back(pending.handle);
+      m_pending.remove(i);
+    }
+  }
+}
+
+#endif
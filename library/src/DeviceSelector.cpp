@@ -0,0 +1,97 @@
+// Copyright 2020-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#if !defined __link
+
+#include <thread/Thread.hpp>
+
+#include "hal/DeviceSelector.hpp"
+
+using namespace hal;
+
+DeviceSelector::DeviceSelector(thread::Signal::Number signal_number)
+  : m_signal_wait(signal_number) {
+  m_signal_context = {
+    .tid = int(thread::Thread::self()),
+    .si_signo = int(signal_number),
+    .si_sigcode = SI_USER,
+    .sig_value = 0,
+    .keep = 1};
+}
+
+DeviceSelector::~DeviceSelector() { m_sources.clear(); }
+
+size_t DeviceSelector::add_file(
+  const DeviceObject::DeviceFile &file,
+  Interest interest,
+  u8 channel) {
+  API_RETURN_VALUE_IF_ERROR(maximum_count);
+  auto *entry = m_sources.allocate();
+  if (entry == nullptr) {
+    return maximum_count;
+  }
+
+  const auto index = m_sources.index(*entry);
+  entry->selector = this;
+  entry->index = index;
+  // anything already buffered has not raised an event
+  entry->o_pending = static_cast<u32>(interest);
+  if (!m_sources.attach(
+        *entry,
+        file,
+        channel,
+        static_cast<u32>(interest),
+        0,
+        handle_event)) {
+    return maximum_count;
+  }
+  m_ready_mask |= 1UL << index;
+  return index;
+}
+
+DeviceSelector &DeviceSelector::remove(size_t index) {
+  m_sources.remove(index);
+  m_ready_mask &= ~(1UL << index);
+  return *this;
+}
+
+bool DeviceSelector::collect() {
+  const u32 ready_mask = m_ready_mask.exchange(0);
+  for (size_t i = 0; i < m_sources.slot_count(); i++) {
+    if (ready_mask & (1UL << i)) {
+      auto &entry = m_sources.at(i);
+      const u32 o_events = entry.o_pending.exchange(0);
+      if (o_events && entry.file != nullptr) {
+        m_events.push_back(Event().set_index(i).set_o_events(o_events));
+      }
+    }
+  }
+  return m_events.count() > 0;
+}
+
+const var::Vector<DeviceSelector::Event> &
+DeviceSelector::wait(const chrono::MicroTime &timeout) {
+  m_events.clear();
+  API_RETURN_VALUE_IF_ERROR(m_events);
+
+  chrono::ClockTimer timer;
+  timer.start();
+  while (collect() == false) {
+    if (!m_signal_wait.wait(timer, timeout)) {
+      // timed out with nothing ready, or the wait failed
+      return m_events;
+    }
+  }
+  return m_events;
+}
+
+int DeviceSelector::handle_event(void *context, const mcu_event_t *event) {
+  // runs in interrupt context: record, then wake the waiting thread
+  auto *entry = reinterpret_cast<Entry *>(context);
+  auto *selector = entry->selector;
+  entry->o_pending |= (event->o_events & entry->o_events);
+  selector->m_ready_mask |= 1UL << entry->index;
+  devfs_signal_callback(&selector->m_signal_context, event);
+  return 1;
+}
+
+#endif
@@ -0,0 +1,140 @@
+// Copyright 2020-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#if !defined __link
+
+#include "hal/DeviceSignalCoalescer.hpp"
+
+using namespace hal;
+
+DeviceSignalCoalescer::DeviceSignalCoalescer(
+  const chrono::MicroTime &window,
+  thread::Signal::Number signal_number)
+  : m_signal(DeviceSignal::IsPersistent::yes, signal_number, 0),
+    m_signal_wait(signal_number), m_window(window) {
+  m_clock.start();
+}
+
+DeviceSignalCoalescer::~DeviceSignalCoalescer() { m_sources.clear(); }
+
+size_t DeviceSignalCoalescer::add_file(
+  const DeviceObject::DeviceFile &file,
+  const DeviceSignal::CreateAction &options) {
+  API_RETURN_VALUE_IF_ERROR(maximum_count);
+  auto *entry = m_sources.allocate();
+  if (entry == nullptr) {
+    return maximum_count;
+  }
+
+  entry->coalescer = this;
+  entry->event_count = 0;
+  entry->o_pending = 0;
+  entry->is_signalled = false;
+  entry->window = m_window;
+  entry->window_end = chrono::MicroTime();
+  if (!m_sources.attach(
+        *entry,
+        file,
+        options.channel(),
+        options.o_events(),
+        options.priority(),
+        handle_event)) {
+    return maximum_count;
+  }
+  return m_sources.index(*entry);
+}
+
+DeviceSignalCoalescer &DeviceSignalCoalescer::remove(size_t index) {
+  m_sources.remove(index);
+  return *this;
+}
+
+DeviceSignalCoalescer &DeviceSignalCoalescer::set_window(
+  size_t index,
+  const chrono::MicroTime &value) {
+  if (index >= m_sources.slot_count() || m_sources.at(index).file == nullptr) {
+    API_RETURN_VALUE_ASSIGN_ERROR(*this, "no such device", EINVAL);
+  }
+  m_sources.at(index).window = value;
+  return *this;
+}
+
+chrono::MicroTime
+DeviceSignalCoalescer::collect(const chrono::MicroTime &now) {
+  chrono::MicroTime result;
+  for (size_t i = 0; i < m_sources.slot_count(); i++) {
+    auto &entry = m_sources.at(i);
+    if (entry.file == nullptr) {
+      continue;
+    }
+
+    if (now < entry.window_end) {
+      // inside the window: merge until it closes
+      if (
+        entry.event_count
+        && (result == chrono::MicroTime() || entry.window_end < result)) {
+        result = entry.window_end;
+      }
+      continue;
+    }
+
+    // events from here on raise the signal again
+    entry.is_signalled = false;
+    const u32 event_count = entry.event_count.exchange(0);
+    const u32 o_events = entry.o_pending.exchange(0);
+    if (event_count) {
+      m_notifications.push_back(Notification()
+                                  .set_index(i)
+                                  .set_channel(entry.channel)
+                                  .set_o_events(o_events)
+                                  .set_count(event_count));
+      entry.window_end = now + entry.window;
+    }
+  }
+  return result;
+}
+
+const var::Vector<DeviceSignalCoalescer::Notification> &
+DeviceSignalCoalescer::wait(const chrono::MicroTime &timeout) {
+  m_notifications.clear();
+  API_RETURN_VALUE_IF_ERROR(m_notifications);
+
+  const auto end = m_clock.micro_time() + timeout;
+  while (true) {
+    const auto now = m_clock.micro_time();
+    auto deadline = collect(now);
+    if (m_notifications.count()) {
+      return m_notifications;
+    }
+
+    if (timeout != chrono::MicroTime()) {
+      if (now >= end) {
+        return m_notifications;
+      }
+      if (deadline == chrono::MicroTime() || end < deadline) {
+        deadline = end;
+      }
+    }
+
+    // woken by the first event on a quiet channel or when a window closes
+    if (!m_signal_wait.wait(m_clock, deadline) && is_error()) {
+      return m_notifications;
+    }
+  }
+}
+
+int DeviceSignalCoalescer::handle_event(
+  void *context,
+  const mcu_event_t *event) {
+  // runs in interrupt context: count, and signal only the first event
+  // until wait() reports the channel
+  auto *entry = reinterpret_cast<Entry *>(context);
+  auto *coalescer = entry->coalescer;
+  entry->event_count++;
+  entry->o_pending |= (event->o_events & entry->o_events);
+  if (!entry->is_signalled.exchange(true)) {
+    devfs_signal_callback((void *)&coalescer->m_signal.context(), event);
+  }
+  return 1;
+}
+
+#endif
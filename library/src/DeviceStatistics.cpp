@@ -0,0 +1,149 @@
+// Copyright 2020-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#include <cinttypes>
+
+#include <printer/Printer.hpp>
+#include <var/StackString.hpp>
+
+#include "hal/DeviceStatistics.hpp"
+
+using namespace hal;
+
+namespace {
+const char *operation_name(DeviceStatistics::Operation value) {
+  switch (value) {
+  case DeviceStatistics::Operation::ioctl:
+    return "ioctl";
+  case DeviceStatistics::Operation::read:
+    return "read";
+  case DeviceStatistics::Operation::write:
+    return "write";
+  }
+  return "unknown";
+}
+} // namespace
+
+printer::Printer &printer::operator<<(
+  printer::Printer &printer,
+  const hal::DeviceStatistics::Entry &a) {
+  printer.key("operation", operation_name(a.operation()));
+  if (a.operation() == hal::DeviceStatistics::Operation::ioctl) {
+    printer.key("request", var::NumberString(a.request(), "0x%08X"));
+  }
+  printer.key("callCount", var::NumberString(a.call_count()))
+    .key("errorCount", var::NumberString(a.error_count()))
+    .key("byteCount", var::NumberString(a.byte_count()))
+    .key(
+      "averageTime",
+      var::NumberString(
+        u64(a.average_time().microseconds()),
+        "%" PRIu64 "us"))
+    .key(
+      "maximumTime",
+      var::NumberString(
+        u64(a.maximum_time().microseconds()),
+        "%" PRIu64 "us"));
+
+  for (size_t i = 0; i < a.histogram().count(); i++) {
+    const auto count = a.histogram().at(i);
+    if (count) {
+      const auto is_last = i == a.histogram().count() - 1;
+      printer.key(
+        var::NumberString(
+          1UL << (is_last ? i : i + 1),
+          is_last ? ">=%luus" : "<%luus"),
+        var::NumberString(count));
+    }
+  }
+  return printer;
+}
+
+printer::Printer &printer::operator<<(
+  printer::Printer &printer,
+  const hal::DeviceStatistics &a) {
+  for (const auto &entry : a.entries()) {
+    if (entry.is_valid()) {
+      if (entry.operation() == hal::DeviceStatistics::Operation::ioctl) {
+        printer.object(
+          var::NumberString(entry.request(), "ioctl:0x%08X"),
+          entry);
+      } else {
+        printer.object(operation_name(entry.operation()), entry);
+      }
+    }
+  }
+  printer.key_bool("overflow", a.is_overflow());
+  if (a.is_overflow()) {
+    printer.key("droppedCount", var::NumberString(a.dropped_count()));
+  }
+  return printer;
+}
+
+DeviceStatistics &DeviceStatistics::record(
+  Operation operation,
+  int request,
+  int result,
+  const chrono::MicroTime &duration) {
+  const auto key_request = operation == Operation::ioctl ? request : 0;
+  Entry *entry = nullptr;
+  for (auto &candidate : m_entries) {
+    if (!candidate.is_valid()) {
+      entry = &candidate;
+      entry->set_operation(operation).set_request(key_request);
+      break;
+    }
+    if (
+      candidate.operation() == operation
+      && candidate.request() == key_request) {
+      entry = &candidate;
+      break;
+    }
+  }
+
+  if (entry == nullptr) {
+    m_dropped_count++;
+    return *this;
+  }
+
+  entry->m_call_count++;
+  if (result < 0) {
+    entry->m_error_count++;
+  } else if (operation != Operation::ioctl) {
+    entry->m_byte_count += u32(result);
+  }
+  entry->m_total_time += duration;
+  if (duration > entry->m_maximum_time) {
+    entry->m_maximum_time = duration;
+  }
+  entry->m_histogram.at(bucket(duration))++;
+  return *this;
+}
+
+DeviceStatistics &DeviceStatistics::reset() {
+  m_entries = EntryList();
+  m_dropped_count = 0;
+  return *this;
+}
+
+const DeviceStatistics::Entry *
+DeviceStatistics::find(Operation operation, int request) const {
+  const auto key_request = operation == Operation::ioctl ? request : 0;
+  for (const auto &entry : m_entries) {
+    if (
+      entry.is_valid() && entry.operation() == operation
+      && entry.request() == key_request) {
+      return &entry;
+    }
+  }
+  return nullptr;
+}
+
+size_t DeviceStatistics::bucket(const chrono::MicroTime &duration) {
+  auto microseconds = duration.microseconds() >> 1;
+  size_t result = 0;
+  while (microseconds && result < bucket_count - 1) {
+    microseconds >>= 1;
+    result++;
+  }
+  return result;
+}
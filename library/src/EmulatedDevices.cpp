@@ -0,0 +1,824 @@
+// Copyright 2020-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#include <algorithm>
+#include <cstring>
+
+#include "hal/EmulatedDevices.hpp"
+
+using namespace hal;
+
+namespace {
+u32 integer_argument(void *argument) {
+  return static_cast<u32>(reinterpret_cast<uintptr_t>(argument));
+}
+
+template <typename Type> Type *typed_argument(void *argument) {
+  return reinterpret_cast<Type *>(argument);
+}
+
+// start and stop bits on the wire
+constexpr u32 uart_bits_per_byte = 10;
+// eight data bits plus ack
+constexpr u32 i2c_bits_per_byte = 9;
+} // namespace
+
+EmulatedFifo::EmulatedFifo(u32 frame_size, u32 frame_count)
+  : m_buffer(frame_size * frame_count), m_frame_size(frame_size),
+    m_frame_count(frame_count) {}
+
+EmulatedFifo &EmulatedFifo::flush() {
+  m_head = m_tail = m_ready_count = 0;
+  m_is_overflow = false;
+  return *this;
+}
+
+int EmulatedFifo::read(int location, void *buf, int nbyte) {
+  if (nbyte < 0 || (nbyte % m_frame_size) != 0) {
+    return set_error(EINVAL);
+  }
+
+  const u32 count = std::min<u32>(nbyte / m_frame_size, m_ready_count);
+  if (count == 0) {
+    return set_error(EAGAIN);
+  }
+
+  auto *destination = reinterpret_cast<u8 *>(buf);
+  for (u32 i = 0; i < count; i++) {
+    memcpy(
+      destination + i * m_frame_size,
+      m_buffer.data_u8() + m_tail * m_frame_size,
+      m_frame_size);
+    m_tail = (m_tail + 1) % m_frame_count;
+  }
+  m_ready_count -= count;
+  return count * m_frame_size;
+}
+
+int EmulatedFifo::write(int location, const void *buf, int nbyte) {
+  if (nbyte < 0 || (nbyte % m_frame_size) != 0) {
+    return set_error(EINVAL);
+  }
+
+  u32 count = nbyte / m_frame_size;
+  if (m_is_writeblock) {
+    count = std::min<u32>(count, m_frame_count - m_ready_count);
+    if (count == 0) {
+      return set_error(EAGAIN);
+    }
+  }
+
+  const auto *source = reinterpret_cast<const u8 *>(buf);
+  for (u32 i = 0; i < count; i++) {
+    memcpy(
+      m_buffer.data_u8() + m_head * m_frame_size,
+      source + i * m_frame_size,
+      m_frame_size);
+    m_head = (m_head + 1) % m_frame_count;
+    if (m_ready_count == m_frame_count) {
+      // oldest unread frame was overwritten
+      m_tail = m_head;
+      m_is_overflow = true;
+    } else {
+      m_ready_count++;
+    }
+  }
+  notify(
+    MCU_EVENT_FLAG_DATA_READY
+    | (m_is_overflow ? MCU_EVENT_FLAG_OVERFLOW : MCU_EVENT_FLAG_NONE));
+  return count * m_frame_size;
+}
+
+BufferMap::Region EmulatedFifo::map() {
+  // BufferMap calls in directly, not through EmulatedFile
+  Lock lock;
+  const u32 tail = m_tail * m_frame_size;
+  const u32 size_ready = m_ready_count * m_frame_size;
+  const u32 first = std::min<u32>(m_buffer.size() - tail, size_ready);
+  return BufferMap::Region(
+    var::View(m_buffer.data_u8() + tail, first),
+    var::View(m_buffer.data_u8(), size_ready - first));
+}
+
+int EmulatedFifo::consume(size_t size) {
+  if (size % m_frame_size) {
+    return set_error(EINVAL);
+  }
+  Lock lock;
+  const u32 count = std::min<u32>(size / m_frame_size, m_ready_count);
+  m_tail = (m_tail + count) % m_frame_count;
+  m_ready_count -= count;
+  return count * m_frame_size;
+}
+
+int EmulatedByteBuffer::ioctl(int request, void *argument) {
+  switch (request) {
+  case I_FIFO_GETINFO: {
+    auto *info = typed_argument<fifo_info_t>(argument);
+    *info = {};
+    info->o_flags = is_writeblock() ? FIFO_FLAG_SET_WRITEBLOCK : 0;
+    info->size = frame_count();
+    info->size_ready = frame_count_ready();
+    info->overflow = take_overflow();
+    return 0;
+  }
+  case I_FIFO_SETATTR: {
+    const auto *attributes = typed_argument<fifo_attr_t>(argument);
+    if (attributes == nullptr) {
+      return 0;
+    }
+    const u32 o_flags = attributes->o_flags;
+    if (o_flags & (FIFO_FLAG_INIT | FIFO_FLAG_EXIT | FIFO_FLAG_FLUSH)) {
+      flush();
+    }
+    if (o_flags & FIFO_FLAG_SET_WRITEBLOCK) {
+      set_writeblock(true);
+    }
+    if (o_flags & FIFO_FLAG_IS_OVERFLOW) {
+      set_writeblock(false);
+    }
+    return 0;
+  }
+  default:
+    return EmulatedDevice::ioctl(request, argument);
+  }
+}
+
+EmulatedByteBufferArray::EmulatedByteBufferArray(u32 channel_count, u32 size)
+  : m_size(size) {
+  for (u32 i = 0; i < channel_count; i++) {
+    m_channels.push_back(EmulatedByteBuffer(size));
+    m_owners.push_back(0);
+  }
+}
+
+int EmulatedByteBufferArray::read(int location, void *buf, int nbyte) {
+  auto *fifo = find(location);
+  return fifo ? fifo->read(0, buf, nbyte) : set_error(EINVAL);
+}
+
+int EmulatedByteBufferArray::write(int location, const void *buf, int nbyte) {
+  auto *fifo = find(location);
+  return fifo ? fifo->write(0, buf, nbyte) : set_error(EINVAL);
+}
+
+int EmulatedByteBufferArray::ioctl(int request, void *argument) {
+  switch (request) {
+  case I_CFIFO_GETINFO: {
+    auto *info = typed_argument<cfifo_info_t>(argument);
+    *info = {};
+    info->count = channel_count();
+    info->size = m_size;
+    // channels past the width of the mask are never reported ready
+    for (u32 i = 0; i < channel_count() && i < sizeof(info->o_ready) * 8;
+         i++) {
+      if (m_channels.at(i).frame_count_ready()) {
+        info->o_ready |= 1UL << i;
+      }
+    }
+    return 0;
+  }
+  case I_CFIFO_GETOWNER:
+  case I_CFIFO_SETOWNER: {
+    auto *owner = typed_argument<mcu_channel_t>(argument);
+    if (owner->loc >= channel_count()) {
+      return set_error(EINVAL);
+    }
+    if (request == I_CFIFO_GETOWNER) {
+      owner->value = m_owners.at(owner->loc);
+    } else {
+      m_owners.at(owner->loc) = int(owner->value);
+    }
+    return 0;
+  }
+  case I_CFIFO_FIFOGETINFO: {
+    auto *fifo_info = typed_argument<cfifo_fifoinfo_t>(argument);
+    auto *fifo = find(fifo_info->channel);
+    return fifo ? fifo->ioctl(I_FIFO_GETINFO, &fifo_info->info)
+                : set_error(EINVAL);
+  }
+  case I_CFIFO_FIFOSETATTR: {
+    auto *fifo_attributes = typed_argument<cfifo_fifoattr_t>(argument);
+    auto *fifo = find(fifo_attributes->channel);
+    return fifo ? fifo->ioctl(I_FIFO_SETATTR, &fifo_attributes->attr)
+                : set_error(EINVAL);
+  }
+  case I_CFIFO_FIFOINIT:
+  case I_CFIFO_FIFOFLUSH:
+  case I_CFIFO_FIFOEXIT: {
+    auto *fifo_request = typed_argument<cfifo_fiforequest_t>(argument);
+    auto *fifo = find(fifo_request->channel);
+    if (fifo == nullptr) {
+      return set_error(EINVAL);
+    }
+    fifo->flush();
+    return 0;
+  }
+  default:
+    return EmulatedDevice::ioctl(request, argument);
+  }
+}
+
+void EmulatedFrameBuffer::get_info(ffifo_info_t &info) {
+  info = {};
+  info.frame_count = frame_count();
+  info.frame_size = frame_size();
+  info.frame_count_ready = frame_count_ready();
+  info.o_flags = (is_writeblock() ? FFIFO_FLAG_SET_WRITEBLOCK : 0)
+                 | (take_overflow() ? FFIFO_FLAG_IS_OVERFLOW : 0);
+}
+
+int EmulatedFrameBuffer::ioctl(int request, void *argument) {
+  switch (request) {
+  case I_FFIFO_GETINFO:
+    get_info(*typed_argument<ffifo_info_t>(argument));
+    return 0;
+  case I_FFIFO_SETATTR: {
+    const auto *attributes = typed_argument<ffifo_attr_t>(argument);
+    if (attributes == nullptr) {
+      return 0;
+    }
+    if (attributes->o_flags & FFIFO_FLAG_SET_WRITEBLOCK) {
+      set_writeblock(true);
+    }
+    if (attributes->o_flags & FFIFO_FLAG_IS_OVERFLOW) {
+      set_writeblock(false);
+    }
+    return 0;
+  }
+  case I_FFIFO_FLUSH:
+    flush();
+    return 0;
+  default:
+    return EmulatedDevice::ioctl(request, argument);
+  }
+}
+
+EmulatedFrameStream::EmulatedFrameStream(
+  u32 frame_size,
+  u32 frame_count,
+  u32 bitrate)
+  : m_transmit(frame_size, frame_count), m_receive(frame_size, frame_count),
+    m_bitrate(bitrate) {}
+
+int EmulatedFrameStream::read(int location, void *buf, int nbyte) {
+  return m_receive.read(location, buf, nbyte);
+}
+
+int EmulatedFrameStream::write(int location, const void *buf, int nbyte) {
+  const int result = m_transmit.write(location, buf, nbyte);
+  if (result <= 0 || !m_is_running) {
+    return result;
+  }
+
+  // the peripheral drains transmit frames straight into receive
+  var::Data frame(m_transmit.frame_size());
+  while (m_transmit.frame_count_ready()) {
+    m_transmit.read(0, frame.data(), frame.size());
+    m_transmit_count++;
+    charge(frame.size() * 8, m_bitrate);
+    if (m_receive.write(0, frame.data(), frame.size()) > 0) {
+      m_receive_count++;
+    }
+  }
+  notify(MCU_EVENT_FLAG_WRITE_COMPLETE | MCU_EVENT_FLAG_DATA_READY);
+  return result;
+}
+
+int EmulatedFrameStream::ioctl(int request, void *argument) {
+  switch (request) {
+  case I_STREAM_FFIFO_GETINFO: {
+    auto *info = typed_argument<stream_ffifo_info_t>(argument);
+    *info = {};
+    m_transmit.get_info(info->tx.ffifo);
+    info->tx.access_count = m_transmit_count;
+    info->tx.error = m_transmit_error;
+    m_receive.get_info(info->rx.ffifo);
+    info->rx.access_count = m_receive_count;
+    info->rx.error = m_receive_error;
+    info->o_status
+      = m_is_running ? STREAM_FFIFO_FLAG_START : STREAM_FFIFO_FLAG_STOP;
+    return 0;
+  }
+  case I_STREAM_FFIFO_SETATTR: {
+    const auto *attributes = typed_argument<stream_ffifo_attr_t>(argument);
+    if (attributes == nullptr) {
+      return 0;
+    }
+    const u32 o_flags = attributes->o_flags;
+    if (o_flags & STREAM_FFIFO_FLAG_FLUSH) {
+      m_transmit.flush();
+      m_receive.flush();
+    }
+    if (o_flags & STREAM_FFIFO_FLAG_START) {
+      m_transmit_count = m_receive_count = 0;
+      m_is_running = true;
+    }
+    if (o_flags & STREAM_FFIFO_FLAG_STOP) {
+      m_is_running = false;
+    }
+    return 0;
+  }
+  default:
+    return EmulatedDevice::ioctl(request, argument);
+  }
+}
+
+EmulatedSpi::EmulatedSpi(u32 frequency) {
+  m_attributes.freq = frequency;
+  m_attributes.width = 8;
+}
+
+EmulatedSpi &EmulatedSpi::set_response(var::View response) {
+  m_response.resize(response.size());
+  memcpy(m_response.data(), response.to_const_void(), response.size());
+  m_response_offset = 0;
+  return *this;
+}
+
+int EmulatedSpi::read(int location, void *buf, int nbyte) {
+  auto *destination = reinterpret_cast<u8 *>(buf);
+  for (int i = 0; i < nbyte; i++) {
+    if (m_response.size() == 0) {
+      destination[i] = 0xff;
+    } else {
+      destination[i] = m_response.data_u8()[m_response_offset];
+      m_response_offset = (m_response_offset + 1) % m_response.size();
+    }
+  }
+  charge(u64(nbyte) * 8, m_attributes.freq);
+  return nbyte;
+}
+
+int EmulatedSpi::write(int location, const void *buf, int nbyte) {
+  charge(u64(nbyte) * 8, m_attributes.freq);
+  return nbyte;
+}
+
+void EmulatedSpi::execute(const Spi::Transaction::Segment &segment) {
+  switch (segment.type) {
+  case Spi::Transaction::Type::assert_cs:
+    m_is_cs_asserted = true;
+    return;
+  case Spi::Transaction::Type::deassert_cs:
+    m_is_cs_asserted = false;
+    return;
+  case Spi::Transaction::Type::write:
+    write(0, segment.source, segment.size);
+    return;
+  case Spi::Transaction::Type::read:
+  case Spi::Transaction::Type::transfer:
+    // clocking in the response charges for both directions
+    read(0, segment.destination, segment.size);
+    return;
+  case Spi::Transaction::Type::delay:
+    Emulator::advance(chrono::MicroTime(segment.size));
+    return;
+  }
+}
+
+int EmulatedSpi::ioctl(int request, void *argument) {
+  switch (request) {
+  case I_SPI_GETINFO: {
+    auto *info = typed_argument<spi_info_t>(argument);
+    *info = {};
+    info->o_flags = SPI_FLAG_IS_FORMAT_SPI | SPI_FLAG_IS_MODE0
+                    | SPI_FLAG_IS_MODE1 | SPI_FLAG_IS_MODE2 | SPI_FLAG_IS_MODE3
+                    | SPI_FLAG_SET_MASTER | SPI_FLAG_SET_FULL_DUPLEX
+                    | SPI_FLAG_SET_HALF_DUPLEX;
+    return 0;
+  }
+  case I_SPI_SETATTR: {
+    const auto *attributes = typed_argument<spi_attr_t>(argument);
+    if (attributes == nullptr) {
+      return 0;
+    }
+    const u32 cs_flags = SPI_FLAG_ASSERT_CS | SPI_FLAG_DEASSERT_CS;
+    if (attributes->o_flags & cs_flags) {
+      m_is_cs_asserted = (attributes->o_flags & SPI_FLAG_ASSERT_CS) != 0;
+      if ((attributes->o_flags & ~cs_flags) == 0) {
+        return 0;
+      }
+    }
+    const auto frequency = m_attributes.freq;
+    m_attributes = *attributes;
+    if (m_attributes.freq == 0) {
+      m_attributes.freq = frequency;
+    }
+    return 0;
+  }
+  case I_SPI_SWAP:
+    // MISO is looped back to MOSI for single byte swaps
+    charge(m_attributes.width, m_attributes.freq);
+    return integer_argument(argument) & 0xff;
+  case request_transaction: {
+    const auto *transaction = typed_argument<Spi::Transaction>(argument);
+    for (const auto &segment : *transaction) {
+      execute(segment);
+    }
+    return 0;
+  }
+  default:
+    return EmulatedDevice::ioctl(request, argument);
+  }
+}
+
+EmulatedI2C::EmulatedI2C(u8 slave_address, u32 register_size)
+  : m_registers(register_size), m_slave_address(slave_address) {
+  m_attributes.freq = 100000;
+}
+
+int EmulatedI2C::prepare(int location, int nbyte) {
+  if (m_attributes.slave_addr[0].addr8[0] != m_slave_address) {
+    m_error = I2C_ERROR_ACK;
+    return set_error(EIO);
+  }
+
+  const int offset
+    = (m_attributes.o_flags & I2C_FLAG_PREPARE_DATA) ? 0 : location;
+  if (offset < 0 || u32(offset) >= m_registers.size()) {
+    m_error = I2C_ERROR_WRITE;
+    return set_error(EINVAL);
+  }
+
+  m_error = I2C_ERROR_NONE;
+  // address byte plus register pointer
+  charge(u64(nbyte + 2) * i2c_bits_per_byte, m_attributes.freq);
+  return offset;
+}
+
+int EmulatedI2C::read(int location, void *buf, int nbyte) {
+  const int offset = prepare(location, nbyte);
+  if (offset < 0) {
+    return offset;
+  }
+  const int count = std::min<int>(nbyte, m_registers.size() - offset);
+  memcpy(buf, m_registers.data_u8() + offset, count);
+  return count;
+}
+
+int EmulatedI2C::write(int location, const void *buf, int nbyte) {
+  const int offset = prepare(location, nbyte);
+  if (offset < 0) {
+    return offset;
+  }
+  const int count = std::min<int>(nbyte, m_registers.size() - offset);
+  memcpy(m_registers.data_u8() + offset, buf, count);
+  return count;
+}
+
+int EmulatedI2C::ioctl(int request, void *argument) {
+  switch (request) {
+  case I_I2C_GETINFO: {
+    auto *info = typed_argument<i2c_info_t>(argument);
+    *info = {};
+    info->o_flags = I2C_FLAG_SET_MASTER | I2C_FLAG_PREPARE_PTR_DATA
+                    | I2C_FLAG_PREPARE_DATA | I2C_FLAG_RESET;
+    info->freq = m_attributes.freq;
+    info->err = m_error;
+    return 0;
+  }
+  case I_I2C_SETATTR: {
+    const auto *attributes = typed_argument<i2c_attr_t>(argument);
+    if (attributes == nullptr) {
+      return 0;
+    }
+    if (attributes->o_flags & I2C_FLAG_RESET) {
+      m_error = I2C_ERROR_NONE;
+      return 0;
+    }
+    const auto frequency = m_attributes.freq;
+    m_attributes = *attributes;
+    if (m_attributes.freq == 0) {
+      m_attributes.freq = frequency;
+    }
+    return 0;
+  }
+  default:
+    return EmulatedDevice::ioctl(request, argument);
+  }
+}
+
+EmulatedUart::EmulatedUart(u32 receive_size, u32 frequency)
+  : m_receive(1, receive_size) {
+  m_attributes.freq = frequency;
+  m_attributes.width = 8;
+}
+
+int EmulatedUart::read(int location, void *buf, int nbyte) {
+  const int count = std::min<int>(nbyte, m_receive.frame_count_ready());
+  if (count == 0) {
+    return set_error(EAGAIN);
+  }
+  return m_receive.read(location, buf, count);
+}
+
+int EmulatedUart::write(int location, const void *buf, int nbyte) {
+  charge(u64(nbyte) * uart_bits_per_byte, m_attributes.freq);
+  m_receive.write(location, buf, nbyte);
+  notify(MCU_EVENT_FLAG_WRITE_COMPLETE | MCU_EVENT_FLAG_DATA_READY);
+  return nbyte;
+}
+
+int EmulatedUart::ioctl(int request, void *argument) {
+  switch (request) {
+  case I_UART_GETVERSION:
+    return 0;
+  case I_UART_GETINFO: {
+    auto *info = typed_argument<uart_info_t>(argument);
+    *info = {};
+    info->o_flags = UART_FLAG_SET_LINE_CODING | UART_FLAG_IS_RX_FIFO;
+    info->size = m_receive.frame_count();
+    info->size_ready = m_receive.frame_count_ready();
+    return 0;
+  }
+  case I_UART_SETATTR: {
+    const auto *attributes = typed_argument<uart_attr_t>(argument);
+    if (attributes == nullptr) {
+      return 0;
+    }
+    const auto frequency = m_attributes.freq;
+    m_attributes = *attributes;
+    if (m_attributes.freq == 0) {
+      m_attributes.freq = frequency;
+    }
+    return 0;
+  }
+  case I_UART_PUT:
+    return write(0, argument, 1) == 1 ? 0 : -1;
+  case I_UART_GET:
+    return read(0, argument, 1) == 1 ? 0 : -1;
+  case I_UART_FLUSH:
+    m_receive.flush();
+    return 0;
+  default:
+    return EmulatedDevice::ioctl(request, argument);
+  }
+}
+
+EmulatedAdc::EmulatedAdc(u32 resolution, u32 frequency)
+  : m_resolution(resolution) {
+  m_attributes.freq = frequency;
+}
+
+int EmulatedAdc::read(int location, void *buf, int nbyte) {
+  const u32 sample_size = bytes_per_sample();
+  if (nbyte < 0 || (nbyte % sample_size) != 0) {
+    return set_error(EINVAL);
+  }
+
+  const u32 maximum = (1UL << m_resolution) - 1;
+  const u32 sample_count = nbyte / sample_size;
+  auto *destination = reinterpret_cast<u8 *>(buf);
+  for (u32 i = 0; i < sample_count; i++) {
+    const u32 value = (m_sample_count++ + u32(location) * 256) & maximum;
+    if (sample_size == sizeof(u32)) {
+      memcpy(destination + i * sample_size, &value, sizeof(u32));
+    } else {
+      const u16 narrow = value;
+      memcpy(destination + i * sample_size, &narrow, sizeof(u16));
+    }
+  }
+
+  // one sample per conversion clock
+  charge(sample_count, m_attributes.freq);
+  return nbyte;
+}
+
+int EmulatedAdc::ioctl(int request, void *argument) {
+  switch (request) {
+  case I_ADC_GETINFO: {
+    auto *info = typed_argument<adc_info_t>(argument);
+    *info = {};
+    info->o_flags = ADC_FLAG_SET_CONVERTER | ADC_FLAG_IS_RIGHT_JUSTIFIED;
+    info->maximum = (1UL << m_resolution) - 1;
+    info->reference_mv = 3300;
+    info->bytes_per_sample = bytes_per_sample();
+    info->resolution = m_resolution;
+    return 0;
+  }
+  case I_ADC_SETATTR: {
+    const auto *attributes = typed_argument<adc_attr_t>(argument);
+    if (attributes == nullptr) {
+      return 0;
+    }
+    const auto frequency = m_attributes.freq;
+    m_attributes = *attributes;
+    if (m_attributes.freq == 0) {
+      m_attributes.freq = frequency;
+    }
+    m_sample_count = 0;
+    return 0;
+  }
+  default:
+    return EmulatedDevice::ioctl(request, argument);
+  }
+}
+
+EmulatedDrive::EmulatedDrive(const Construct &options)
+  : m_memory(options.write_block_size() * options.write_block_count()) {
+  m_info.o_flags = DRIVE_FLAG_ERASE_BLOCKS | DRIVE_FLAG_ERASE_DEVICE
+                   | DRIVE_FLAG_INIT | DRIVE_FLAG_RESET;
+  m_info.addressable_size = 1;
+  m_info.write_block_size = options.write_block_size();
+  m_info.num_write_blocks = options.write_block_count();
+  m_info.erase_block_size = options.erase_block_size();
+  m_info.erase_block_time = options.erase_block_time().microseconds();
+  m_info.erase_device_time
+    = options.erase_block_size()
+        ? options.erase_block_time().microseconds()
+            * (m_memory.size() / options.erase_block_size())
+        : 0;
+  m_info.bitrate = options.bitrate();
+  m_info.page_program_size = options.write_block_size();
+  memset(m_memory.data(), 0xff, m_memory.size());
+}
+
+int EmulatedDrive::read(int location, void *buf, int nbyte) {
+  if (location < 0 || u32(location) > m_memory.size()) {
+    return set_error(EINVAL);
+  }
+  const int count = std::min<int>(nbyte, m_memory.size() - location);
+  memcpy(buf, m_memory.data_u8() + location, count);
+  charge(u64(count) * 8, m_info.bitrate);
+  return count;
+}
+
+int EmulatedDrive::write(int location, const void *buf, int nbyte) {
+  if (location < 0 || u32(location) >= m_memory.size()) {
+    return set_error(ENOSPC);
+  }
+  const int count = std::min<int>(nbyte, m_memory.size() - location);
+  memcpy(m_memory.data_u8() + location, buf, count);
+  charge(u64(count) * 8, m_info.bitrate);
+  return count;
+}
+
+int EmulatedDrive::erase(u32 start, u32 end) {
+  const u32 block_size = m_info.erase_block_size;
+  if (block_size == 0) {
+    return set_error(EINVAL);
+  }
+  if (start >= m_memory.size()) {
+    return set_error(EINVAL);
+  }
+  const u32 first = start - (start % block_size);
+  const u32 last = std::min<u32>(
+    std::max<u32>(end, first + block_size),
+    m_memory.size());
+
+  u32 address = first;
+  while (address < last) {
+    // the memory need not be a whole number of erase blocks
+    const u32 size = std::min<u32>(block_size, last - address);
+    memset(m_memory.data_u8() + address, 0xff, size);
+    Emulator::advance(chrono::MicroTime(m_info.erase_block_time));
+    address += size;
+  }
+  // like the sos drivers, report how far the erase got
+  return address - start;
+}
+
+int EmulatedDrive::ioctl(int request, void *argument) {
+  switch (request) {
+  case I_DRIVE_GETINFO:
+    *typed_argument<drive_info_t>(argument) = m_info;
+    return 0;
+  case I_DRIVE_ISBUSY:
+    // erase time is charged up front so the drive is never busy
+    return 0;
+  case I_DRIVE_SETATTR: {
+    const auto *attributes = typed_argument<drive_attr_t>(argument);
+    if (attributes == nullptr) {
+      return 0;
+    }
+    if (attributes->o_flags & DRIVE_FLAG_ERASE_DEVICE) {
+      memset(m_memory.data(), 0xff, m_memory.size());
+      Emulator::advance(chrono::MicroTime(m_info.erase_device_time));
+      return 0;
+    }
+    if (attributes->o_flags & DRIVE_FLAG_ERASE_BLOCKS) {
+      return erase(attributes->start, attributes->end);
+    }
+    return 0;
+  }
+  default:
+    return EmulatedDevice::ioctl(request, argument);
+  }
+}
+
+EmulatedFlash::EmulatedFlash(const Construct &options)
+  : m_memory(options.page_size() * options.page_count()),
+    m_page_size(options.page_size()), m_page_count(options.page_count()),
+    m_erase_page_time(options.erase_page_time()),
+    m_bitrate(options.bitrate()) {
+  memset(m_memory.data(), 0xff, m_memory.size());
+}
+
+int EmulatedFlash::read(int location, void *buf, int nbyte) {
+  if (location < 0 || u32(location) > m_memory.size()) {
+    return set_error(EINVAL);
+  }
+  const int count = std::min<int>(nbyte, m_memory.size() - location);
+  memcpy(buf, m_memory.data_u8() + location, count);
+  return count;
+}
+
+int EmulatedFlash::write_page(const flash_writepage_t &write_page) {
+  if (
+    write_page.nbyte > sizeof(write_page.buf)
+    || write_page.addr + write_page.nbyte > m_memory.size()) {
+    return set_error(EINVAL);
+  }
+
+  u8 *destination = m_memory.data_u8() + write_page.addr;
+  for (u32 i = 0; i < write_page.nbyte; i++) {
+    destination[i] &= write_page.buf[i];
+  }
+  charge(u64(write_page.nbyte) * 8, m_bitrate);
+  return write_page.nbyte;
+}
+
+int EmulatedFlash::erase_page(u32 page) {
+  if (page >= m_page_count) {
+    return set_error(EINVAL);
+  }
+  memset(m_memory.data_u8() + page * m_page_size, 0xff, m_page_size);
+  Emulator::advance(m_erase_page_time);
+  return 0;
+}
+
+int EmulatedFlash::ioctl(int request, void *argument) {
+  switch (request) {
+  case I_FLASH_GETVERSION:
+    return 0;
+  case I_FLASH_GETINFO: {
+    auto *info = typed_argument<flash_info_t>(argument);
+    *info = {};
+    info->o_events = MCU_EVENT_FLAG_WRITE_COMPLETE;
+    return 0;
+  }
+  case I_FLASH_GETSIZE:
+    return m_memory.size();
+  case I_FLASH_GETPAGE: {
+    const u32 address = integer_argument(argument);
+    if (address >= m_memory.size()) {
+      return set_error(EINVAL);
+    }
+    return address / m_page_size;
+  }
+  case I_FLASH_GET_PAGEINFO: {
+    auto *page_info = typed_argument<flash_pageinfo_t>(argument);
+    if (page_info->page >= m_page_count) {
+      return set_error(EINVAL);
+    }
+    page_info->addr = page_info->page * m_page_size;
+    page_info->size = m_page_size;
+    return 0;
+  }
+  case I_FLASH_WRITEPAGE:
+    return write_page(*typed_argument<flash_writepage_t>(argument));
+  case I_FLASH_ERASE_PAGE:
+    return erase_page(integer_argument(argument));
+  default:
+    return EmulatedDevice::ioctl(request, argument);
+  }
+}
+
+int EmulatedGpio::ioctl(int request, void *argument) {
+  switch (request) {
+  case I_PIO_SETATTR: {
+    const auto *attributes = typed_argument<pio_attr_t>(argument);
+    if (attributes == nullptr) {
+      return 0;
+    }
+    const u32 mask = attributes->o_pinmask;
+    if (attributes->o_flags & PIO_FLAG_SET_OUTPUT) {
+      m_direction |= mask;
+    }
+    if (attributes->o_flags & PIO_FLAG_SET_INPUT) {
+      m_direction &= ~mask;
+    }
+    if (attributes->o_flags & PIO_FLAG_SET) {
+      m_output |= mask;
+    }
+    if (attributes->o_flags & PIO_FLAG_CLEAR) {
+      m_output &= ~mask;
+    }
+    return 0;
+  }
+  case I_PIO_SETMASK:
+    m_output |= integer_argument(argument);
+    return 0;
+  case I_PIO_CLRMASK:
+    m_output &= ~integer_argument(argument);
+    return 0;
+  case I_PIO_SET:
+    m_output = integer_argument(argument);
+    return 0;
+  case I_PIO_GET:
+    *typed_argument<u32>(argument) = value();
+    return 0;
+  default:
+    return EmulatedDevice::ioctl(request, argument);
+  }
+}
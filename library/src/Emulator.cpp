@@ -0,0 +1,233 @@
+// Copyright 2020-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#include <atomic>
+
+#include <thread/Mutex.hpp>
+#include <var/Vector.hpp>
+
+#include "hal/Emulator.hpp"
+
+using namespace hal;
+
+namespace {
+
+struct Registration {
+  var::PathString path;
+  EmulatedDevice *device;
+};
+
+// driver calls are serialized like a single-core devfs
+thread::Mutex &emulator_mutex() {
+  static thread::Mutex mutex;
+  return mutex;
+}
+
+var::Vector<Registration> &registrations() {
+  static var::Vector<Registration> list;
+  return list;
+}
+
+std::atomic<u64> &clock_microseconds() {
+  static std::atomic<u64> value{0};
+  return value;
+}
+
+// keep clear of descriptors the host hands out
+std::atomic<int> next_fileno{0x4000};
+
+struct Notification {
+  EmulatedDevice *device;
+  mcu_event_handler_t handler;
+  u32 o_events;
+  void *data;
+};
+
+// filled by notify() on the thread making the driver call
+var::Vector<Notification> &notifications() {
+  thread_local var::Vector<Notification> list;
+  return list;
+}
+
+} // namespace
+
+EmulatedDevice::Lock::Lock() { emulator_mutex().lock(); }
+
+EmulatedDevice::Lock::~Lock() { emulator_mutex().unlock(); }
+
+void EmulatedDevice::charge(u64 bit_count, u32 bitrate) {
+  if (bitrate == 0) {
+    return;
+  }
+  clock_microseconds() += bit_count * 1000000ULL / bitrate;
+}
+
+int EmulatedDevice::ioctl(int request, void *argument) {
+  if (request == I_MCU_SETACTION && argument != nullptr) {
+    m_action = *reinterpret_cast<const mcu_action_t *>(argument);
+    return 0;
+  }
+  return set_error(EINVAL);
+}
+
+void EmulatedDevice::notify(u32 o_events, void *data) {
+  if (
+    m_action.handler.callback == nullptr
+    || (m_action.o_events & o_events) == 0) {
+    return;
+  }
+  notifications().push_back({this, m_action.handler, o_events, data});
+}
+
+void EmulatedDevice::run_notifications() {
+  auto &list = notifications();
+  if (list.count() == 0) {
+    return;
+  }
+
+  // the callbacks must not disturb the result of the driver call
+  const auto error_number = errno;
+  // a callback that makes a driver call drains the list itself
+  while (list.count()) {
+    const auto notification = list.at(0);
+    list.remove(0);
+    mcu_event_t event
+      = {.o_events = notification.o_events, .data = notification.data};
+    const auto &handler = notification.handler;
+    // like an isr, a zero return removes the handler
+    if (handler.callback(handler.context, &event) == 0) {
+      thread::Mutex::Guard mutex_guard(emulator_mutex());
+      auto &action = notification.device->m_action;
+      if (
+        action.handler.callback == handler.callback
+        && action.handler.context == handler.context) {
+        action.handler.callback = nullptr;
+      }
+    }
+  }
+  errno = error_number;
+}
+
+void Emulator::add(var::StringView path, EmulatedDevice &device) {
+  thread::Mutex::Guard mutex_guard(emulator_mutex());
+  for (auto &registration : registrations()) {
+    if (registration.path.string_view() == path) {
+      registration.device = &device;
+      return;
+    }
+  }
+  registrations().push_back({var::PathString(path), &device});
+}
+
+void Emulator::remove(var::StringView path) {
+  thread::Mutex::Guard mutex_guard(emulator_mutex());
+  auto &list = registrations();
+  for (size_t i = 0; i < list.count(); i++) {
+    if (list.at(i).path.string_view() == path) {
+      list.remove(i);
+      return;
+    }
+  }
+}
+
+void Emulator::clear() {
+  thread::Mutex::Guard mutex_guard(emulator_mutex());
+  registrations().clear();
+}
+
+EmulatedDevice *Emulator::find(var::StringView path) {
+  thread::Mutex::Guard mutex_guard(emulator_mutex());
+  for (const auto &registration : registrations()) {
+    if (registration.path.string_view() == path) {
+      return registration.device;
+    }
+  }
+  return nullptr;
+}
+
+chrono::MicroTime Emulator::clock() {
+  return chrono::MicroTime(clock_microseconds().load());
+}
+
+void Emulator::advance(const chrono::MicroTime &duration) {
+  clock_microseconds() += duration.microseconds();
+}
+
+void Emulator::reset_clock() { clock_microseconds() = 0; }
+
+EmulatedFile::EmulatedFile(
+  var::StringView path,
+  fs::OpenMode open_mode FSAPI_LINK_DECLARE_DRIVER_LAST) {
+  m_device = Emulator::find(path);
+  if (m_device == nullptr) {
+    API_RETURN_ASSIGN_ERROR(path.data(), ENOENT);
+  }
+  m_fileno = next_fileno++;
+}
+
+int EmulatedFile::interface_lseek(int offset, int whence) const {
+  if (m_device == nullptr) {
+    errno = EBADF;
+    return -1;
+  }
+
+  switch (whence) {
+  case SEEK_SET:
+    m_location = offset;
+    break;
+  case SEEK_CUR:
+    m_location += offset;
+    break;
+  default:
+    errno = EINVAL;
+    return -1;
+  }
+  return m_location;
+}
+
+int EmulatedFile::interface_read(void *buf, int nbyte) const {
+  if (m_device == nullptr) {
+    errno = EBADF;
+    return -1;
+  }
+  int result = 0;
+  {
+    thread::Mutex::Guard mutex_guard(emulator_mutex());
+    result = m_device->read(m_location, buf, nbyte);
+    if (result > 0 && m_device->is_seekable()) {
+      m_location += result;
+    }
+  }
+  EmulatedDevice::run_notifications();
+  return result;
+}
+
+int EmulatedFile::interface_write(const void *buf, int nbyte) const {
+  if (m_device == nullptr) {
+    errno = EBADF;
+    return -1;
+  }
+  int result = 0;
+  {
+    thread::Mutex::Guard mutex_guard(emulator_mutex());
+    result = m_device->write(m_location, buf, nbyte);
+    if (result > 0 && m_device->is_seekable()) {
+      m_location += result;
+    }
+  }
+  EmulatedDevice::run_notifications();
+  return result;
+}
+
+int EmulatedFile::interface_ioctl(int request, void *argument) const {
+  if (m_device == nullptr) {
+    errno = EBADF;
+    return -1;
+  }
+  int result = 0;
+  {
+    thread::Mutex::Guard mutex_guard(emulator_mutex());
+    result = m_device->ioctl(request, argument);
+  }
+  EmulatedDevice::run_notifications();
+  return result;
+}
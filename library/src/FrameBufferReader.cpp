@@ -0,0 +1,51 @@
+// Copyright 2020-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#include "hal/FrameBufferReader.hpp"
+
+using namespace hal;
+
+FrameBufferReader::FrameBufferReader(
+  const FrameBuffer &frame_buffer,
+  u32 frame_count)
+  : FrameBufferReader(
+    frame_buffer.file(),
+    frame_buffer.get_info(),
+    frame_count) {}
+
+FrameBufferReader::FrameBufferReader(
+  const DeviceObject::DeviceFile &file,
+  const FrameBuffer::Info &info,
+  u32 frame_count)
+  : m_file(&file) {
+  API_RETURN_IF_ERROR();
+  if (!info.is_valid()) {
+    API_RETURN_ASSIGN_ERROR("not a frame buffer", EINVAL);
+  }
+  m_frame_size = info.frame_size();
+  m_frame_count = frame_count ? frame_count : info.frame_count();
+  m_arena.resize(m_frame_size * m_frame_count);
+}
+
+const FrameBufferReader::Frames &FrameBufferReader::read() {
+  m_frames = Frames();
+  API_RETURN_VALUE_IF_ERROR(m_frames);
+
+  int result = 0;
+  int error_number = 0;
+  {
+    api::ErrorScope error_scope;
+    result = m_file->read(m_arena).return_value();
+    error_number = is_error() ? error().error_number() : 0;
+  }
+
+  if (error_number == EAGAIN) {
+    return m_frames;
+  }
+
+  if (error_number != 0) {
+    API_RETURN_VALUE_ASSIGN_ERROR(m_frames, "read failed", error_number);
+  }
+
+  m_frames = Frames(m_arena.data_u8(), m_frame_size, result / m_frame_size);
+  return m_frames;
+}
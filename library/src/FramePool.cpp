@@ -0,0 +1,82 @@
+// Copyright 2020-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#include <algorithm>
+
+#include "hal/FramePool.hpp"
+
+using namespace hal;
+
+FramePool::FramePool(const FrameBuffer &frame_buffer, u32 frame_count)
+  : m_frame_buffer(frame_buffer) {
+  const auto info = frame_buffer.get_info();
+  API_RETURN_IF_ERROR();
+  if (!info.is_valid()) {
+    API_RETURN_ASSIGN_ERROR("not a frame buffer", EINVAL);
+  }
+  m_frame_size = info.frame_size();
+  m_frame_count = frame_count ? frame_count : info.frame_count();
+  m_arena.resize(m_frame_size * m_frame_count);
+}
+
+var::View FramePool::acquire() {
+  API_RETURN_VALUE_IF_ERROR(var::View());
+  if (free_count() == 0) {
+    flush();
+    if (free_count() == 0) {
+      return var::View();
+    }
+  }
+  const auto result = slot(m_tail + m_submitted_count + m_acquired_count);
+  m_acquired_count++;
+  return result;
+}
+
+FramePool &FramePool::submit() {
+  API_RETURN_VALUE_IF_ERROR(*this);
+  if (m_acquired_count == 0) {
+    API_RETURN_VALUE_ASSIGN_ERROR(*this, "no frame to submit", EINVAL);
+  }
+  m_acquired_count--;
+  m_submitted_count++;
+  if (submitted_count() >= m_batch_count) {
+    flush();
+  }
+  return *this;
+}
+
+FramePool &FramePool::flush() {
+  while (submitted_count() && is_success()) {
+    // the run of frames up to the end of the arena
+    const u32 count = std::min(m_submitted_count, m_frame_count - m_tail);
+    const u32 written = write(count);
+    m_tail += written;
+    if (m_tail == m_frame_count) {
+      m_tail = 0;
+    }
+    m_submitted_count -= written;
+    if (written < count) {
+      // the fifo is full
+      break;
+    }
+  }
+  return *this;
+}
+
+u32 FramePool::write(u32 count) {
+  int result = 0;
+  int error_number = 0;
+  {
+    api::ErrorScope error_scope;
+    result = m_frame_buffer.file().write(slot(m_tail, count)).return_value();
+    error_number = is_error() ? error().error_number() : 0;
+  }
+
+  if (error_number == EAGAIN) {
+    return 0;
+  }
+
+  if (error_number != 0) {
+    API_RETURN_VALUE_ASSIGN_ERROR(0, "write failed", error_number);
+  }
+  return result / m_frame_size;
+}
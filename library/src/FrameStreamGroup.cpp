@@ -0,0 +1,84 @@
+// Copyright 2020-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#include <chrono/ClockTimer.hpp>
+
+#include "hal/FrameStreamGroup.hpp"
+
+using namespace hal;
+
+FrameStreamGroup &FrameStreamGroup::add(const FrameStream &stream) {
+  API_RETURN_VALUE_IF_ERROR(*this);
+  if (m_count == maximum_count) {
+    API_RETURN_VALUE_ASSIGN_ERROR(*this, "too many streams", ENOSPC);
+  }
+  m_streams.at(m_count++) = &stream;
+  return *this;
+}
+
+FrameStreamGroup &FrameStreamGroup::prepare() {
+  API_RETURN_VALUE_IF_ERROR(*this);
+  m_failed_index = maximum_count;
+  for (size_t i = 0; i < m_count; i++) {
+    m_streams.at(i)->stop().flush();
+    if (is_error()) {
+      m_failed_index = i;
+      return *this;
+    }
+  }
+  return *this;
+}
+
+FrameStreamGroup &FrameStreamGroup::start() {
+  API_RETURN_VALUE_IF_ERROR(*this);
+  m_failed_index = maximum_count;
+  if (m_count == 0) {
+    return *this;
+  }
+
+  // built up front so the loop below is only the requests
+  const auto attributes = FrameStream::Attributes().set_start();
+  var::Array<chrono::MicroTime, maximum_count> issued;
+  var::Array<chrono::MicroTime, maximum_count> completed;
+
+  chrono::ClockTimer timer;
+  timer.start();
+  for (size_t i = 0; i < m_count; i++) {
+    issued.at(i) = timer.micro_time();
+    m_streams.at(i)->set_attributes(attributes);
+    completed.at(i) = timer.micro_time();
+    if (is_error()) {
+      m_failed_index = i;
+      break;
+    }
+  }
+  timer.stop();
+
+  if (m_failed_index < m_count) {
+    // leave none running; the start error stays for the caller
+    for (size_t i = 0; i < m_failed_index; i++) {
+      api::ErrorScope error_scope;
+      m_streams.at(i)->stop();
+    }
+    return *this;
+  }
+
+  // the stream starts somewhere inside its request, call it the midpoint
+  const auto first = issued.at(0) + (completed.at(0) - issued.at(0)) / 2;
+  m_resolution = chrono::MicroTime();
+  for (size_t i = 0; i < m_count; i++) {
+    const auto duration = completed.at(i) - issued.at(i);
+    m_skew.at(i) = issued.at(i) + duration / 2 - first;
+    if (duration > m_resolution) {
+      m_resolution = duration;
+    }
+  }
+  return *this;
+}
+
+FrameStreamGroup &FrameStreamGroup::stop() {
+  API_RETURN_VALUE_IF_ERROR(*this);
+  for (size_t i = 0; i < m_count; i++) {
+    m_streams.at(i)->stop();
+  }
+  return *this;
+}
@@ -0,0 +1,118 @@
+// Copyright 2020-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#include "hal/FrameStreamMonitor.hpp"
+
+using namespace hal;
+
+FrameStreamMonitor::FrameStreamMonitor(
+  const FrameStream &stream,
+  const Construct &options)
+  : m_stream(stream), m_construct(options) {}
+
+FrameStreamMonitor &FrameStreamMonitor::reset() {
+  m_is_first = true;
+  m_drift = 0;
+  m_statistics = Statistics();
+  return *this;
+}
+
+const FrameStreamMonitor::Statistics &FrameStreamMonitor::update() {
+  API_RETURN_VALUE_IF_ERROR(m_statistics);
+  // keep the raw struct: Info refers to itself and must not be copied
+  const stream_ffifo_info_t current = m_stream.get_info().info();
+  API_RETURN_VALUE_IF_ERROR(m_statistics);
+
+  const auto interval = m_timer.micro_time();
+  m_timer.restart();
+  if (m_is_first) {
+    m_is_first = false;
+    m_last = current;
+    return m_statistics;
+  }
+
+  const auto receive = update_channel(
+    current.rx,
+    m_last.rx,
+    m_statistics.receive(),
+    interval);
+  const auto transmit = update_channel(
+    current.tx,
+    m_last.tx,
+    m_statistics.transmit(),
+    interval);
+  m_last = current;
+
+  const bool is_receive = current.rx.ffifo.frame_count != 0;
+  const bool is_transmit = current.tx.ffifo.frame_count != 0;
+  if (is_receive && is_transmit) {
+    // access counts wrap, so only the difference of the deltas is used
+    m_drift += s32(receive.frame_count() - transmit.frame_count());
+  }
+
+  Alert alerts = Alert::none;
+  if (is_receive) {
+    // a one-frame fifo would otherwise be overrun when empty
+    const u32 high_water
+      = m_construct.receive_high_water() ? m_construct.receive_high_water()
+        : current.rx.ffifo.frame_count > 1 ? current.rx.ffifo.frame_count - 1
+                                           : 1;
+    if (receive.frame_count_ready() >= high_water) {
+      alerts = alerts | Alert::receive_overrun;
+    }
+    if (current.rx.ffifo.o_flags & FFIFO_FLAG_IS_OVERFLOW) {
+      alerts = alerts | Alert::receive_overflow;
+    }
+    if (current.rx.error) {
+      alerts = alerts | Alert::receive_error;
+    }
+  }
+
+  if (is_transmit) {
+    if (transmit.frame_count_ready() < m_construct.transmit_low_water()) {
+      alerts = alerts | Alert::transmit_underrun;
+    }
+    if (current.tx.error) {
+      alerts = alerts | Alert::transmit_error;
+    }
+  }
+
+  const u32 drift_size = m_drift < 0 ? u32(-m_drift) : u32(m_drift);
+  if (m_construct.maximum_drift() && drift_size > m_construct.maximum_drift()) {
+    alerts = alerts | Alert::drift;
+  }
+
+  m_statistics = Statistics()
+                   .set_receive(receive)
+                   .set_transmit(transmit)
+                   .set_drift(m_drift)
+                   .set_interval(interval)
+                   .set_alerts(alerts);
+
+  if (alerts != Alert::none && m_construct.callback() != nullptr) {
+    m_construct.callback()(m_construct.context(), m_statistics);
+  }
+  return m_statistics;
+}
+
+FrameStreamMonitor::ChannelStatistics FrameStreamMonitor::update_channel(
+  const stream_ffifo_channel_info_t &current,
+  const stream_ffifo_channel_info_t &last,
+  const ChannelStatistics &previous,
+  const chrono::MicroTime &interval) {
+  const u32 frame_count = current.access_count - last.access_count;
+  const u64 microseconds = interval.microseconds();
+  // the error value and the overflow flag stay set until cleared, so only
+  // a change counts as a new event
+  const bool is_new_error = current.error != 0 && current.error != last.error;
+  const bool is_overflow = current.ffifo.o_flags & FFIFO_FLAG_IS_OVERFLOW;
+  const bool was_overflow = last.ffifo.o_flags & FFIFO_FLAG_IS_OVERFLOW;
+  const bool is_new_overflow = is_overflow && !was_overflow;
+  return ChannelStatistics()
+    .set_frame_count(frame_count)
+    .set_frames_per_second(
+      microseconds ? u32(u64(frame_count) * 1000000ULL / microseconds) : 0)
+    .set_frame_count_ready(current.ffifo.frame_count_ready)
+    .set_error_count(previous.error_count() + (is_new_error ? 1 : 0))
+    .set_overflow_count(previous.overflow_count() + (is_new_overflow ? 1 : 0))
+    .set_error(current.error);
+}
@@ -0,0 +1,267 @@
+// Copyright 2020-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#include <algorithm>
+
+#include <chrono/ClockTimer.hpp>
+
+#include "hal/FrameStreamPipeline.hpp"
+
+using namespace hal;
+
+void FrameStreamPipeline::Queue::initialize(u32 frame_size, u32 depth) {
+  m_frame_size = frame_size;
+  m_depth = depth;
+  m_head = m_tail = m_count = 0;
+  m_arena.resize(frame_size * depth);
+}
+
+FrameStreamPipeline::FrameStreamPipeline(
+  const FrameStream &stream,
+  const Construct &options)
+  : m_stream(stream), m_construct(options) {
+  if (
+    options.queue_depth() == 0
+    || options.queue_depth() > maximum_queue_depth) {
+    API_RETURN_ASSIGN_ERROR("invalid queue depth", EINVAL);
+  }
+
+  const auto info = stream.get_info();
+  API_RETURN_IF_ERROR();
+  const auto frame_size = info.receive().frame_buffer_info().frame_size();
+  if (frame_size == 0) {
+    API_RETURN_ASSIGN_ERROR("stream has no receive channel", EINVAL);
+  }
+  m_queues.at(0).initialize(frame_size, options.queue_depth());
+}
+
+FrameStreamPipeline &FrameStreamPipeline::add_stage(const Stage &stage) {
+  API_RETURN_VALUE_IF_ERROR(*this);
+  if (m_is_running) {
+    API_RETURN_VALUE_ASSIGN_ERROR(*this, "pipeline is running", EBUSY);
+  }
+  if (m_stage_count == maximum_stage_count || stage.function() == nullptr) {
+    API_RETURN_VALUE_ASSIGN_ERROR(*this, "cannot add stage", EINVAL);
+  }
+
+  const auto input_frame_size = m_queues.at(m_stage_count).frame_size();
+  m_stages.at(m_stage_count) = stage;
+  m_stage_count++;
+  m_queues.at(m_stage_count).initialize(
+    stage.frame_size() ? stage.frame_size() : input_frame_size,
+    m_construct.queue_depth());
+  return *this;
+}
+
+FrameStreamPipeline &FrameStreamPipeline::set_sink(const Sink &sink) {
+  API_RETURN_VALUE_IF_ERROR(*this);
+  if (m_is_running) {
+    API_RETURN_VALUE_ASSIGN_ERROR(*this, "pipeline is running", EBUSY);
+  }
+  m_sink = sink;
+  return *this;
+}
+
+u32 FrameStreamPipeline::process() {
+  API_RETURN_VALUE_IF_ERROR(0);
+  if (m_construct.is_threaded() == IsThreaded::yes) {
+    API_RETURN_VALUE_ASSIGN_ERROR(0, "pipeline is threaded", EINVAL);
+  }
+
+  u32 result = 0;
+  thread::Mutex::Guard mutex_guard(m_mutex);
+  bool is_progress;
+  do {
+    // drain from the sink back so every queue has room for the one before
+    is_progress = false;
+    while (run_sink()) {
+      result++;
+      is_progress = true;
+    }
+    for (size_t i = m_stage_count; i > 0; i--) {
+      while (run_stage(i - 1)) {
+        is_progress = true;
+      }
+    }
+    while (run_source()) {
+      is_progress = true;
+    }
+  } while (is_progress && is_success() && m_error_number == 0);
+
+  if (m_error_number) {
+    API_RETURN_VALUE_ASSIGN_ERROR(result, "read failed", m_error_number);
+  }
+  return result;
+}
+
+FrameStreamPipeline &FrameStreamPipeline::start() {
+  API_RETURN_VALUE_IF_ERROR(*this);
+  if (m_construct.is_threaded() == IsThreaded::no || m_is_running) {
+    API_RETURN_VALUE_ASSIGN_ERROR(*this, "cannot start", EINVAL);
+  }
+
+  m_error_number = 0;
+  m_is_running = true;
+  for (size_t i = 0; i < m_stage_count + 2; i++) {
+    m_workers.at(i) = {this, int(i) - 1};
+    m_threads.at(i) = thread::Thread(
+      thread::Thread::Attributes()
+        .set_stack_size(m_construct.stack_size())
+        .set_detach_state(thread::Thread::DetachState::joinable),
+      thread::Thread::Construct()
+        .set_argument(&m_workers.at(i))
+        .set_function(work_thread));
+    if (is_error()) {
+      // stop the workers that did start; the error stays for the caller
+      join_threads();
+      return *this;
+    }
+    m_thread_count++;
+  }
+  return *this;
+}
+
+FrameStreamPipeline &FrameStreamPipeline::stop() {
+  if (!m_is_running) {
+    return *this;
+  }
+  join_threads();
+  if (m_error_number) {
+    API_RETURN_VALUE_ASSIGN_ERROR(*this, "read failed", m_error_number);
+  }
+  return *this;
+}
+
+void FrameStreamPipeline::join_threads() {
+  m_mutex.lock();
+  m_is_running = false;
+  m_cond.broadcast();
+  m_mutex.unlock();
+  for (size_t i = 0; i < m_thread_count; i++) {
+    api::ErrorScope error_scope;
+    m_threads.at(i).join();
+  }
+  m_thread_count = 0;
+}
+
+bool FrameStreamPipeline::run_source() {
+  auto &queue = m_queues.at(0);
+  if (queue.is_full()) {
+    return false;
+  }
+
+  // the slot belongs to the source until it is pushed
+  const auto slot = queue.back();
+  m_mutex.unlock();
+  int result = 0;
+  int error_number = 0;
+  {
+    api::ErrorScope error_scope;
+    result = m_stream.file().read(slot).return_value();
+    error_number = is_error() ? error().error_number() : 0;
+  }
+  m_mutex.lock();
+
+  if (error_number && error_number != EAGAIN) {
+    // wakes the other workers so they stop too
+    m_error_number = error_number;
+    m_cond.broadcast();
+    return false;
+  }
+
+  if (error_number || result <= 0) {
+    // no frame yet
+    return false;
+  }
+  queue.push(result);
+  return true;
+}
+
+bool FrameStreamPipeline::run_stage(size_t index) {
+  auto &input = m_queues.at(index);
+  auto &output = m_queues.at(index + 1);
+  if (input.is_empty() || output.is_full()) {
+    return false;
+  }
+
+  const auto &stage = m_stages.at(index);
+  const auto source = input.front();
+  const auto destination = output.back();
+  m_mutex.unlock();
+  const auto size = stage.function()(stage.context(), source, destination);
+  m_mutex.lock();
+
+  input.pop();
+  if (size) {
+    output.push(std::min<size_t>(size, destination.size()));
+  } else {
+    m_dropped_count++;
+  }
+  return true;
+}
+
+bool FrameStreamPipeline::run_sink() {
+  auto &queue = m_queues.at(m_stage_count);
+  if (queue.is_empty()) {
+    return false;
+  }
+
+  if (m_sink.function() == nullptr) {
+    // nowhere to go
+    queue.pop();
+    m_dropped_count++;
+    return true;
+  }
+
+  const auto frame = queue.front();
+  m_mutex.unlock();
+  const auto is_accepted = m_sink.function()(m_sink.context(), frame);
+  m_mutex.lock();
+
+  if (is_accepted) {
+    queue.pop();
+  }
+  return is_accepted;
+}
+
+bool FrameStreamPipeline::run(int index) {
+  if (index < 0) {
+    return run_source();
+  }
+  if (size_t(index) == m_stage_count) {
+    return run_sink();
+  }
+  return run_stage(index);
+}
+
+bool FrameStreamPipeline::is_blocked_outside(int index) {
+  if (index < 0) {
+    return !m_queues.at(0).is_full();
+  }
+  if (size_t(index) == m_stage_count) {
+    return !m_queues.at(m_stage_count).is_empty();
+  }
+  return false;
+}
+
+void FrameStreamPipeline::work(int index) {
+  m_mutex.lock();
+  while (m_is_running && m_error_number == 0) {
+    if (run(index)) {
+      m_cond.broadcast();
+    } else if (is_blocked_outside(index)) {
+      // a failed read or refused sink frame: retry without spinning
+      m_mutex.unlock();
+      chrono::wait(chrono::MicroTime(1000));
+      m_mutex.lock();
+    } else {
+      m_cond.wait();
+    }
+  }
+  m_mutex.unlock();
+}
+
+void *FrameStreamPipeline::work_thread(void *args) {
+  auto *worker = reinterpret_cast<Worker *>(args);
+  worker->pipeline->work(worker->index);
+  return nullptr;
+}
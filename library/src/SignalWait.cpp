@@ -0,0 +1,64 @@
+// Copyright 2020-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#if !defined __link
+
+#include <ctime>
+
+#include "hal/SignalWait.hpp"
+
+using namespace hal;
+
+SignalWait::SignalWait(thread::Signal::Number signal_number)
+  : m_signal_number(int(signal_number)) {
+  sigemptyset(&m_set);
+  sigaddset(&m_set, m_signal_number);
+  sigset_t previous;
+  const auto result = pthread_sigmask(SIG_BLOCK, &m_set, &previous);
+  if (result != 0) {
+    API_RETURN_ASSIGN_ERROR("pthread_sigmask", result);
+  }
+  m_is_restore = sigismember(&previous, m_signal_number) == 0;
+}
+
+SignalWait::~SignalWait() {
+  if (!m_is_restore) {
+    return;
+  }
+  // a late signal must not reach the default handler once unblocked
+  const struct timespec zero = {};
+  while (sigtimedwait(&m_set, nullptr, &zero) > 0) {
+  }
+  pthread_sigmask(SIG_UNBLOCK, &m_set, nullptr);
+}
+
+bool SignalWait::wait(
+  const chrono::ClockTimer &timer,
+  const chrono::MicroTime &timeout) const {
+  API_RETURN_VALUE_IF_ERROR(false);
+  int result;
+  if (timeout.microseconds() == 0) {
+    result = sigwaitinfo(&m_set, nullptr);
+  } else {
+    const auto elapsed = timer.micro_time();
+    if (elapsed >= timeout) {
+      return false;
+    }
+    const auto remaining = timeout - elapsed;
+    const struct timespec interval = {
+      .tv_sec = time_t(remaining.seconds()),
+      .tv_nsec = long(remaining.microseconds() % 1000000UL) * 1000};
+    result = sigtimedwait(&m_set, nullptr, &interval);
+  }
+
+  if (result < 0) {
+    if (errno == EAGAIN) {
+      return false;
+    }
+    if (errno != EINTR) {
+      API_RETURN_VALUE_ASSIGN_ERROR(false, "sigtimedwait", errno);
+    }
+  }
+  return true;
+}
+
+#endif
@@ -1,10 +1,234 @@
 // Copyright 2020-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
 
+#include <cstring>
+
 #include <printer/Printer.hpp>
+#include <var/Data.hpp>
 #include <var/StackString.hpp>
 
 #include "hal/Spi.hpp"
 
+#if defined HALAPI_IS_EMULATED
+#include "hal/EmulatedDevices.hpp"
+#endif
+
+using namespace hal;
+
+namespace {
+u16 swap_bytes(u16 value) { return __builtin_bswap16(value); }
+u32 swap_bytes(u32 value) { return __builtin_bswap32(value); }
+// a u16 never holds more than one 16-bit frame
+u16 swap_halves(u16 value) { return value; }
+u32 swap_halves(u32 value) { return (value << 16) | (value >> 16); }
+
+// frames go out in memory order, so the most significant frame of each
+// word is moved first; plain loops the compiler can vectorize, and their
+// own inverse for the received words
+template <typename Word>
+void to_frame_order(
+  const Word *source,
+  Word *destination,
+  size_t count,
+  size_t frame_size) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  if (frame_size == 1) {
+    for (size_t i = 0; i < count; i++) {
+      destination[i] = swap_bytes(source[i]);
+    }
+  } else {
+    for (size_t i = 0; i < count; i++) {
+      destination[i] = swap_halves(source[i]);
+    }
+  }
+#else
+  if (source != destination) {
+    memcpy(destination, source, count * sizeof(Word));
+  }
+#endif
+}
+
+template <typename Frame> Frame load_frame(const u8 *source) {
+  Frame result;
+  memcpy(&result, source, sizeof(Frame));
+  return result;
+}
+
+template <typename Frame> void store_frame(u8 *destination, u32 value) {
+  const auto frame = Frame(value);
+  memcpy(destination, &frame, sizeof(Frame));
+}
+
+size_t frame_size(u8 width) {
+  return width <= 8 ? 1 : width <= 16 ? 2 : 4;
+}
+} // namespace
+
+// built once; chip select is toggled for every transaction
+const Spi &Spi::assert_cs() const {
+  static const Attributes attributes
+    = Attributes().set_flags(Flags::assert_cs);
+  return ioctl(I_SPI_SETATTR, (void *)attributes.attributes());
+}
+
+const Spi &Spi::deassert_cs() const {
+  static const Attributes attributes
+    = Attributes().set_flags(Flags::deassert_cs);
+  return ioctl(I_SPI_SETATTR, (void *)attributes.attributes());
+}
+
+const Spi &Spi::execute(const Transaction &transaction) const {
+  API_RETURN_VALUE_IF_ERROR(*this);
+  if (!transaction.is_valid()) {
+    API_RETURN_VALUE_ASSIGN_ERROR(*this, "invalid transaction", EINVAL);
+  }
+
+#if defined HALAPI_IS_EMULATED
+  return ioctl(EmulatedSpi::request_transaction, (void *)&transaction);
+#else
+  bool is_cs_asserted = false;
+  for (const auto &segment : transaction) {
+    execute_segment(segment);
+    if (DeviceObject::is_error()) {
+      if (is_cs_asserted) {
+        api::ErrorScope error_scope;
+        deassert_cs();
+      }
+      return *this;
+    }
+    if (segment.type == Transaction::Type::assert_cs) {
+      is_cs_asserted = true;
+    } else if (segment.type == Transaction::Type::deassert_cs) {
+      is_cs_asserted = false;
+    }
+  }
+  return *this;
+#endif
+}
+
+const Spi &Spi::swap(
+  const u16 *source,
+  u16 *destination,
+  size_t count,
+  u8 width) const {
+  return swap_words(source, destination, count, width);
+}
+
+const Spi &Spi::swap(
+  const u32 *source,
+  u32 *destination,
+  size_t count,
+  u8 width) const {
+  return swap_words(source, destination, count, width);
+}
+
+template <typename Word>
+const Spi &Spi::swap_words(
+  const Word *source,
+  Word *destination,
+  size_t count,
+  u8 width) const {
+  API_RETURN_VALUE_IF_ERROR(*this);
+  const u8 frame_width = width ? width : m_width;
+  if (frame_width == 0) {
+    API_RETURN_VALUE_ASSIGN_ERROR(*this, "frame width not known", EINVAL);
+  }
+  const auto size_of_frame = frame_size(frame_width);
+  if (frame_width > 32 || size_of_frame > sizeof(Word)) {
+    API_RETURN_VALUE_ASSIGN_ERROR(*this, "width does not fit word", EINVAL);
+  }
+
+  const u32 size = count * sizeof(Word);
+  if (size_of_frame == sizeof(Word)) {
+    // the driver moves one frame per word
+    return exchange(source, destination, size, size_of_frame);
+  }
+
+  if (m_swap_buffer.size() < size) {
+    m_swap_buffer.resize(size);
+    API_RETURN_VALUE_IF_ERROR(*this);
+  }
+  auto *packed = reinterpret_cast<Word *>(m_swap_buffer.data());
+  to_frame_order(source, packed, count, size_of_frame);
+  exchange(packed, destination, size, size_of_frame);
+  if (DeviceObject::is_success()) {
+    to_frame_order(destination, destination, count, size_of_frame);
+  }
+  return *this;
+}
+
+const Spi &Spi::exchange(
+  const void *source,
+  void *destination,
+  u32 size,
+  size_t size_of_frame) const {
+  const auto transaction = Transaction().transfer(
+    var::View(source, size),
+    var::View(destination, size));
+#if defined __link && !defined HALAPI_IS_EMULATED
+  // the frame size comes from the caller, not from the last attributes
+  swap_frames(*transaction.begin(), size_of_frame);
+  return *this;
+#else
+  return execute(transaction);
+#endif
+}
+
+#if defined __link
+void Spi::swap_frames(
+  const Transaction::Segment &segment,
+  size_t size_of_frame) const {
+  // I_SPI_SWAP exchanges one frame and returns the one received
+  const auto *source = reinterpret_cast<const u8 *>(segment.source);
+  auto *destination = reinterpret_cast<u8 *>(segment.destination);
+  for (u32 offset = 0; offset + size_of_frame <= segment.size;
+       offset += size_of_frame) {
+    const u32 value = size_of_frame == 1   ? load_frame<u8>(source + offset)
+                      : size_of_frame == 2 ? load_frame<u16>(source + offset)
+                                           : load_frame<u32>(source + offset);
+    const auto result
+      = u32(ioctl(I_SPI_SWAP, MCU_INT_CAST(value)).return_value());
+    API_RETURN_IF_ERROR();
+    if (size_of_frame == 1) {
+      store_frame<u8>(destination + offset, result);
+    } else if (size_of_frame == 2) {
+      store_frame<u16>(destination + offset, result);
+    } else {
+      store_frame<u32>(destination + offset, result);
+    }
+  }
+}
+#endif
+
+void Spi::execute_segment(const Transaction::Segment &segment) const {
+  const auto source = var::View(segment.source, segment.size);
+  const auto destination = var::View(segment.destination, segment.size);
+  switch (segment.type) {
+  case Transaction::Type::assert_cs:
+    assert_cs();
+    return;
+  case Transaction::Type::deassert_cs:
+    deassert_cs();
+    return;
+  case Transaction::Type::write:
+    write(source);
+    return;
+  case Transaction::Type::read:
+    read(destination);
+    return;
+  case Transaction::Type::transfer:
+#if defined __link
+    // full duplex needs aio, which the host does not have
+    swap_frames(segment, frame_size(m_width));
+#else
+    transfer(Transfer().set_source(source).set_destination(destination));
+#endif
+    return;
+  case Transaction::Type::delay:
+    chrono::wait(chrono::MicroTime(segment.size));
+    return;
+  }
+}
+
 printer::Printer &
 printer::operator<<(printer::Printer &printer, const hal::Spi::Attributes &a) {
   printer.key("flags", var::NumberString(static_cast<u32>(a.o_flags())));
@@ -0,0 +1,118 @@
+// Copyright 2020-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#include "hal/SpiBus.hpp"
+
+using namespace hal;
+
+SpiBus::Guard::Guard(SpiBus &bus, size_t client)
+  : m_bus(bus), m_is_acquired(bus.acquire()) {
+  if (m_is_acquired) {
+    m_bus.select(client);
+  }
+}
+
+SpiBus::Guard::~Guard() {
+  if (m_is_acquired) {
+    m_bus.release();
+  }
+}
+
+SpiBus::SpiBus(
+  const var::StringView device,
+  fs::OpenMode open_mode FSAPI_LINK_DECLARE_DRIVER_LAST)
+  : m_spi(device, open_mode FSAPI_LINK_INHERIT_DRIVER_LAST) {}
+
+size_t SpiBus::add_client(const Spi::Attributes &attributes) {
+  API_RETURN_VALUE_IF_ERROR(no_client);
+  thread::Mutex::Guard mutex_guard(m_mutex);
+  if (m_client_count == maximum_client_count) {
+    API_RETURN_VALUE_ASSIGN_ERROR(no_client, "too many clients", ENOSPC);
+  }
+  m_clients.at(m_client_count) = attributes;
+  return m_client_count++;
+}
+
+SpiBus &SpiBus::set_client(size_t client, const Spi::Attributes &attributes) {
+  API_RETURN_VALUE_IF_ERROR(*this);
+  if (client >= m_client_count) {
+    API_RETURN_VALUE_ASSIGN_ERROR(*this, "no such client", EINVAL);
+  }
+  if (!acquire()) {
+    return *this;
+  }
+  m_clients.at(client) = attributes;
+  if (m_active_client == client) {
+    m_active_client = no_client;
+  }
+  release();
+  return *this;
+}
+
+SpiBus &SpiBus::execute(size_t client, const Spi::Transaction &transaction) {
+  API_RETURN_VALUE_IF_ERROR(*this);
+  Guard guard(*this, client);
+  API_RETURN_VALUE_IF_ERROR(*this);
+  m_spi.execute(transaction);
+  return *this;
+}
+
+SpiBus &SpiBus::execute(const Batch &batch) {
+  API_RETURN_VALUE_IF_ERROR(*this);
+  if (!batch.is_valid()) {
+    API_RETURN_VALUE_ASSIGN_ERROR(*this, "invalid batch", EINVAL);
+  }
+
+  if (!acquire()) {
+    return *this;
+  }
+  for (size_t i = 0; i < batch.count() && is_success(); i++) {
+    const auto &entry = batch.m_entries.at(i);
+    select(entry.client);
+    if (is_success()) {
+      m_spi.execute(*entry.transaction);
+    }
+  }
+  release();
+  return *this;
+}
+
+bool SpiBus::acquire() {
+  const auto self = thread::Thread::self();
+  m_mutex.lock();
+  if (m_is_owned && pthread_equal(m_owner, self)) {
+    // waiting would never end
+    m_mutex.unlock();
+    API_RETURN_VALUE_ASSIGN_ERROR(false, "bus already held", EDEADLK);
+  }
+  const u32 ticket = m_next_ticket++;
+  while (ticket != m_serving_ticket) {
+    m_cond.wait();
+  }
+  m_owner = self;
+  m_is_owned = true;
+  m_mutex.unlock();
+  return true;
+}
+
+void SpiBus::release() {
+  m_mutex.lock();
+  m_is_owned = false;
+  m_serving_ticket++;
+  m_cond.broadcast();
+  m_mutex.unlock();
+}
+
+void SpiBus::select(size_t client) {
+  API_RETURN_IF_ERROR();
+  if (client >= m_client_count) {
+    API_RETURN_ASSIGN_ERROR("no such client", EINVAL);
+  }
+  if (client == m_active_client) {
+    return;
+  }
+
+  m_spi.set_attributes(m_clients.at(client));
+  m_reconfigure_count++;
+  // a failed write leaves the peripheral in an unknown state
+  m_active_client = is_success() ? client : no_client;
+}
@@ -0,0 +1,85 @@
+// Copyright 2020-2021 Tyler Gilbert and Stratify Labs, Inc; see LICENSE.md
+
+#include "hal/TimestampedFrameReader.hpp"
+
+using namespace hal;
+
+TimestampedFrameReader::TimestampedFrameReader(
+  const FrameStream &stream,
+  u32 frame_count)
+  : m_stream(stream),
+    m_reader(
+      stream.file(),
+      stream.get_info().receive().frame_buffer_info(),
+      frame_count) {
+  m_timer.start();
+}
+
+const TimestampedFrameReader::Frames &TimestampedFrameReader::read() {
+  m_frames.m_frames = FrameBufferReader::Frames();
+  API_RETURN_VALUE_IF_ERROR(m_frames);
+
+  const auto &frames = m_reader.read();
+  if (frames.is_empty()) {
+    return m_frames;
+  }
+
+  const u32 count = frames.count();
+  const auto rx = m_stream.get_info().info().rx;
+  const auto now = m_timer.micro_time();
+  API_RETURN_VALUE_IF_ERROR(m_frames);
+
+  // frames filled so far minus frames still waiting in the fifo
+  const u32 end_sequence = rx.access_count - rx.ffifo.frame_count_ready;
+  const u32 sequence = end_sequence - count;
+  const auto step = s32(sequence - m_next_sequence);
+  if (m_is_sequence_valid && step > 0) {
+    m_statistics.set_gap_count(m_statistics.gap_count() + 1)
+      .set_dropped_count(m_statistics.dropped_count() + u32(step));
+  }
+  // a step back is a restart; the count carries on from the new sequence
+  m_is_sequence_valid = true;
+  m_next_sequence = end_sequence;
+  m_statistics.set_frame_count(m_statistics.frame_count() + count);
+
+  update_period(rx.access_count, now);
+
+  m_frames.m_frames = frames;
+  m_frames.m_sequence = sequence;
+  m_frames.m_period = m_statistics.period();
+  // the newest frame finished just now; the last one read is older by the
+  // frames still waiting
+  const auto waiting = chrono::MicroTime(
+    u64(m_statistics.period().microseconds()) * rx.ffifo.frame_count_ready);
+  m_frames.m_timestamp = now > waiting ? now - waiting : chrono::MicroTime();
+  return m_frames;
+}
+
+void TimestampedFrameReader::update_period(
+  u32 access_count,
+  const chrono::MicroTime &now) {
+  // the driver count goes back when the stream is restarted
+  if (m_is_sample_valid && s32(access_count - m_sample_access_count) > 0) {
+    const u64 measured = (now - m_sample_time).microseconds()
+                         / (access_count - m_sample_access_count);
+    const u64 period = m_statistics.period().microseconds();
+    if (period == 0) {
+      m_statistics.set_period(chrono::MicroTime(measured));
+    } else {
+      const u64 deviation
+        = measured > period ? measured - period : period - measured;
+      const u64 jitter = m_statistics.jitter().microseconds();
+      // smoothed with a 1/16 gain, like the rtp jitter estimate
+      m_statistics.set_period(chrono::MicroTime((period * 15 + measured) / 16))
+        .set_jitter(chrono::MicroTime(
+          deviation > jitter ? jitter + (deviation - jitter) / 16
+                             : jitter - (jitter - deviation) / 16));
+      if (chrono::MicroTime(deviation) > m_statistics.maximum_jitter()) {
+        m_statistics.set_maximum_jitter(chrono::MicroTime(deviation));
+      }
+    }
+  }
+  m_is_sample_valid = true;
+  m_sample_access_count = access_count;
+  m_sample_time = now;
+}
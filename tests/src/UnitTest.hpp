@@ -1,19 +1,1508 @@
 ﻿
+#include <atomic>
 #include <cstdio>
 
 #include "chrono.hpp"
 #include "fs.hpp"
 #include "printer.hpp"
 #include "sys.hpp"
+#include "thread.hpp"
 #include "var.hpp"
 
+#include "hal.hpp"
+
 #include "test/Test.hpp"
 
+// The emulator cases are only built with HAL_API_IS_EMULATED; each device
+// has its own path and keeps its state between cases. The target cases
+// need aio or driver events, which only Stratify OS provides, and run
+// against the fifo given with --fifo.
 class UnitTest : public test::Test {
 public:
-  UnitTest(var::StringView name) : test::Test(name) {}
+  UnitTest(const sys::Cli &cli) : test::Test(cli.get_name()), m_cli(cli) {
+#if defined HALAPI_IS_EMULATED
+    hal::Emulator::add(m_drive_path, m_drive);
+    hal::Emulator::add(m_byte_buffer_path, m_byte_buffer);
+    hal::Emulator::add(m_spi_path, m_spi);
+    hal::Emulator::add(m_byte_buffer_array_path, m_byte_buffer_array);
+    hal::Emulator::add(m_frame_buffer_path, m_frame_buffer);
+    hal::Emulator::add(m_stream_path, m_stream);
+    hal::Emulator::add(m_group_stream_path, m_group_stream);
+#endif
+  }
+
+#if defined HALAPI_IS_EMULATED
+  ~UnitTest() { hal::Emulator::clear(); }
+#endif
 
-  bool execute_class_api_case() { return true; }
+  bool execute_class_api_case() {
+#if defined HALAPI_IS_EMULATED
+    TEST_ASSERT_RESULT(drive_api_case());
+    TEST_ASSERT_RESULT(emulator_notify_api_case());
+    TEST_ASSERT_RESULT(device_batch_api_case());
+    TEST_ASSERT_RESULT(scatter_gather_api_case());
+    TEST_ASSERT_RESULT(device_statistics_api_case());
+    TEST_ASSERT_RESULT(attribute_cache_api_case());
+    TEST_ASSERT_RESULT(byte_buffer_ring_api_case());
+    TEST_ASSERT_RESULT(buffer_map_api_case());
+    TEST_ASSERT_RESULT(byte_buffer_array_api_case());
+    TEST_ASSERT_RESULT(frame_buffer_reader_api_case());
+    TEST_ASSERT_RESULT(frame_pool_api_case());
+    TEST_ASSERT_RESULT(frame_stream_pipeline_api_case());
+    TEST_ASSERT_RESULT(frame_stream_monitor_api_case());
+    TEST_ASSERT_RESULT(frame_stream_group_api_case());
+    TEST_ASSERT_RESULT(timestamped_frame_reader_api_case());
+    TEST_ASSERT_RESULT(spi_transaction_api_case());
+    TEST_ASSERT_RESULT(spi_bus_api_case());
+    TEST_ASSERT_RESULT(spi_swap_api_case());
+#endif
+#if !defined __link
+    TEST_ASSERT_RESULT(transfer_api_case());
+    TEST_ASSERT_RESULT(aio_ring_api_case());
+    TEST_ASSERT_RESULT(scatter_transfer_api_case());
+    TEST_ASSERT_RESULT(device_selector_api_case());
+#if defined __cpp_impl_coroutine
+    TEST_ASSERT_RESULT(device_executor_api_case());
+#endif
+    TEST_ASSERT_RESULT(device_event_queue_api_case());
+    TEST_ASSERT_RESULT(device_signal_coalescer_api_case());
+    TEST_ASSERT_RESULT(byte_buffer_wait_ready_api_case());
+#endif
+    return true;
+  }
 
 private:
+  const sys::Cli &m_cli;
+
+  var::StringView path(var::StringView option, var::StringView value) const {
+    const auto result = m_cli.get_option(option);
+    return result.is_empty() ? value : result;
+  }
+
+  const var::StringView m_drive_path = path("drive", "/dev/drive0");
+  const var::StringView m_byte_buffer_path = path("fifo", "/dev/fifo");
+  const var::StringView m_spi_path = path("spi", "/dev/spi0");
+  const var::StringView m_byte_buffer_array_path = path("cfifo", "/dev/cfifo");
+  const var::StringView m_frame_buffer_path = path("ffifo", "/dev/ffifo");
+  const var::StringView m_stream_path = path("stream", "/dev/stream0");
+  const var::StringView m_group_stream_path = path("stream1", "/dev/stream1");
+
+#if defined HALAPI_IS_EMULATED
+  // the last erase block is cut short by the end of the memory
+  hal::EmulatedDrive m_drive{
+    hal::EmulatedDrive::Construct().set_write_block_count(9)};
+  hal::EmulatedByteBuffer m_byte_buffer{64};
+  hal::EmulatedSpi m_spi{20000000};
+  hal::EmulatedByteBufferArray m_byte_buffer_array{4, 16};
+  static constexpr u32 frame_size = 16;
+  static constexpr u32 frame_count = 8;
+  hal::EmulatedFrameBuffer m_frame_buffer{frame_size, frame_count};
+  hal::EmulatedFrameStream m_stream{frame_size, frame_count, 1000000};
+  hal::EmulatedFrameStream m_group_stream{frame_size, frame_count, 1000000};
+
+  // counts the writes that reach the driver
+  static int count_notify(void *context, const mcu_event_t *event) {
+    (*reinterpret_cast<u32 *>(context))++;
+    return 1;
+  }
+
+  struct Collector {
+    u32 count = 0;
+    u8 last = 0;
+    size_t size = 0;
+    // the sink refuses frames past this count
+    u32 limit = 0xffffffff;
+  };
+
+  // keeps even frames and inverts them
+  static size_t invert_even(void *context, var::View input, var::View output) {
+    if (input.to_const_u8()[0] & 0x01) {
+      return 0;
+    }
+    for (size_t i = 0; i < input.size(); i++) {
+      output.to_u8()[i] = ~input.to_const_u8()[i];
+    }
+    return input.size();
+  }
+
+  // keeps the first half of each frame
+  static size_t take_half(void *context, var::View input, var::View output) {
+    for (size_t i = 0; i < output.size(); i++) {
+      output.to_u8()[i] = input.to_const_u8()[i];
+    }
+    return input.size() / 2;
+  }
+
+  static bool collect(void *context, var::View frame) {
+    auto *collector = reinterpret_cast<Collector *>(context);
+    if (collector->count == collector->limit) {
+      return false;
+    }
+    collector->count++;
+    collector->last = frame.to_const_u8()[0];
+    collector->size = frame.size();
+    return true;
+  }
+
+  // one frame per value, each byte set to the value
+  template <size_t Count>
+  static void fill_frames(u8 (&frames)[Count], u8 value) {
+    for (size_t i = 0; i < Count; i++) {
+      frames[i] = value + i / frame_size;
+    }
+  }
+
+  struct MonitorLog {
+    u32 count = 0;
+    hal::FrameStreamMonitor::Alert alerts{};
+  };
+
+  static void log_alerts(
+    void *context,
+    const hal::FrameStreamMonitor::Statistics &statistics) {
+    auto *log = reinterpret_cast<MonitorLog *>(context);
+    log->count++;
+    log->alerts = statistics.alerts();
+  }
+
+  struct BusRequest {
+    hal::SpiBus *bus = nullptr;
+    size_t client = 0;
+    const hal::Spi::Transaction *transaction = nullptr;
+    std::atomic<bool> is_done{false};
+  };
+
+  static void *execute_on_bus(void *context) {
+    auto *request = reinterpret_cast<BusRequest *>(context);
+    request->bus->execute(request->client, *request->transaction);
+    request->is_done = true;
+    return nullptr;
+  }
+
+  struct Reader {
+    const hal::ByteBuffer *fifo = nullptr;
+    u32 call_count = 0;
+    u8 buffer[8] = {};
+  };
+
+  // reads the fifo from inside its own driver callback
+  static int read_on_notify(void *context, const mcu_event_t *event) {
+    auto *reader = reinterpret_cast<Reader *>(context);
+    reader->call_count++;
+    api::ErrorScope error_scope;
+    reader->fifo->read(var::View(reader->buffer));
+    // zero removes the handler, like returning zero from an isr
+    return 0;
+  }
+
+  bool drive_api_case() {
+    hal::Drive drive(m_drive_path);
+    const auto info = drive.get_info();
+    TEST_ASSERT(drive.is_success());
+    TEST_ASSERT(info.size() == 9 * 512);
+
+    const u32 size = info.size();
+    const u32 block_size = info.erase_block_size();
+    u8 buffer[64];
+    u8 erased[64];
+    var::View(buffer).fill<u8>(0);
+    var::View(erased).fill<u8>(0xff);
+
+    TEST_ASSERT(drive.seek(size - sizeof(buffer)).write(var::View(buffer))
+                  .is_success());
+    TEST_ASSERT(drive.erase_blocks(block_size, size).is_success());
+    TEST_ASSERT(drive.seek(size - sizeof(buffer)).read(var::View(buffer))
+                  .is_success());
+    TEST_ASSERT(var::View(buffer) == var::View(erased));
+
+    {
+      api::ErrorScope error_scope;
+      TEST_ASSERT(drive.erase_blocks(size, size + block_size).is_error());
+      TEST_ASSERT(drive.error().error_number() == EINVAL);
+    }
+    return true;
+  }
+
+  bool emulator_notify_api_case() {
+    m_byte_buffer.flush();
+    hal::ByteBuffer fifo(m_byte_buffer_path);
+    Reader reader;
+    reader.fifo = &fifo;
+    mcu_action_t action = {
+      .o_events = MCU_EVENT_FLAG_DATA_READY,
+      .handler = {.callback = read_on_notify, .context = &reader}};
+    TEST_ASSERT(fifo.ioctl(I_MCU_SETACTION, &action).is_success());
+
+    // the callback runs after the driver lock is released
+    const u8 data[] = {1, 2, 3, 4};
+    TEST_ASSERT(fifo.write(var::View(data)).is_success());
+    TEST_ASSERT(fifo.return_value() == sizeof(data));
+    TEST_ASSERT(reader.call_count == 1);
+    TEST_ASSERT(var::View(reader.buffer, sizeof(data)) == var::View(data));
+    TEST_ASSERT(m_byte_buffer.frame_count_ready() == 0);
+
+    // the handler was removed by its zero return
+    TEST_ASSERT(fifo.write(var::View(data)).is_success());
+    TEST_ASSERT(reader.call_count == 1);
+    TEST_ASSERT(m_byte_buffer.frame_count_ready() == sizeof(data));
+    return true;
+  }
+
+  bool device_batch_api_case() {
+    using Operation = hal::DeviceStatistics::Operation;
+    m_byte_buffer.flush();
+    hal::DeviceStatistics statistics;
+    hal::ByteBuffer fifo(m_byte_buffer_path);
+    fifo.set_statistics(&statistics);
+
+    const u8 data[] = {1, 2, 3, 4, 5, 6, 7, 8};
+    u8 received[8] = {};
+
+    // views that follow each other in memory go to the driver as one call
+    hal::DeviceBatch batch;
+    batch.set_coalesce()
+      .write(var::View(data, 4))
+      .write(var::View(data + 4, 4))
+      .read(var::View(received, 4))
+      .read(var::View(received + 4, 4));
+    TEST_ASSERT(batch.submit(fifo).is_success());
+    TEST_ASSERT(batch.error_count() == 0);
+    TEST_ASSERT(statistics.find(Operation::write)->call_count() == 1);
+    TEST_ASSERT(statistics.find(Operation::read)->call_count() == 1);
+    TEST_ASSERT(batch.operations().at(3).return_value() == 4);
+    TEST_ASSERT(var::View(received) == var::View(data));
+
+    // a gap between the views keeps them apart; a short read fills the
+    // first view and leaves the rest to the second
+    statistics.reset();
+    var::View(received).fill<u8>(0);
+    hal::DeviceBatch split;
+    split.set_coalesce()
+      .write(var::View(data, 2))
+      .write(var::View(data + 4, 4))
+      .read(var::View(received, 4))
+      .read(var::View(received + 4, 4));
+    TEST_ASSERT(split.submit(fifo).is_success());
+    TEST_ASSERT(statistics.find(Operation::write)->call_count() == 2);
+    TEST_ASSERT(statistics.find(Operation::read)->call_count() == 1);
+    TEST_ASSERT(split.operations().at(2).return_value() == 4);
+    TEST_ASSERT(split.operations().at(3).return_value() == 2);
+    TEST_ASSERT(var::View(received, 2) == var::View(data, 2));
+    TEST_ASSERT(var::View(received + 2, 4) == var::View(data + 4, 4));
+
+    // a resubmitted batch reports only the latest results
+    hal::DeviceBatch reads;
+    reads.read(var::View(received, 4));
+    TEST_ASSERT(reads.submit(fifo).is_success());
+    TEST_ASSERT(reads.error_count() == 1);
+    TEST_ASSERT(reads.operations().at(0).error_number() == EAGAIN);
+
+    TEST_ASSERT(fifo.write(var::View(data + 4, 4)).is_success());
+    TEST_ASSERT(reads.submit(fifo).is_success());
+    TEST_ASSERT(reads.error_count() == 0);
+    TEST_ASSERT(reads.operations().at(0).return_value() == 4);
+    TEST_ASSERT(var::View(received, 4) == var::View(data + 4, 4));
+    return true;
+  }
+
+  bool scatter_gather_api_case() {
+    m_byte_buffer.flush();
+    hal::ByteBuffer fifo(m_byte_buffer_path);
+
+    const u8 expected[] = {1, 2, 3, 4, 5, 6, 7, 8};
+    const u8 head[] = {1, 2, 3};
+    const u8 tail[] = {4, 5, 6, 7, 8};
+    const var::Array<var::View, 2> write_views
+      = {var::View(head), var::View(tail)};
+    TEST_ASSERT(fifo.gather_write(write_views).is_success());
+    TEST_ASSERT(m_byte_buffer.frame_count_ready() == sizeof(expected));
+
+    // the second view is only half filled
+    u8 first[4] = {};
+    u8 second[8] = {};
+    const var::Array<var::View, 2> read_views
+      = {var::View(first), var::View(second)};
+    TEST_ASSERT(fifo.scatter_read(read_views) == sizeof(expected));
+    TEST_ASSERT(fifo.is_success());
+    TEST_ASSERT(var::View(first) == var::View(expected, 4));
+    TEST_ASSERT(var::View(second, 4) == var::View(expected + 4, 4));
+    return true;
+  }
+
+  bool device_statistics_api_case() {
+    using Operation = hal::DeviceStatistics::Operation;
+    m_byte_buffer.flush();
+    hal::DeviceStatistics statistics;
+    hal::ByteBuffer fifo(m_byte_buffer_path);
+    fifo.set_statistics(&statistics);
+
+    TEST_ASSERT(fifo.get_info().size() == 64);
+    TEST_ASSERT(fifo.get_info().size_ready() == 0);
+    const auto *get_info = statistics.find(Operation::ioctl, I_FIFO_GETINFO);
+    TEST_ASSERT(get_info != nullptr);
+    TEST_ASSERT(get_info->call_count() == 2 && get_info->error_count() == 0);
+
+    {
+      // nothing to read
+      api::ErrorScope error_scope;
+      u8 buffer[4];
+      TEST_ASSERT(fifo.read(var::View(buffer)).is_error());
+    }
+    const auto *read = statistics.find(Operation::read);
+    TEST_ASSERT(read != nullptr && read->error_count() == 1);
+
+    fifo.set_statistics(nullptr);
+    TEST_ASSERT(fifo.get_info().size() == 64);
+    TEST_ASSERT(get_info->call_count() == 2);
+    TEST_ASSERT(!statistics.is_overflow());
+
+    statistics.reset();
+    TEST_ASSERT(statistics.find(Operation::ioctl, I_FIFO_GETINFO) == nullptr);
+    return true;
+  }
+
+  bool attribute_cache_api_case() {
+    hal::AttributeCache cache;
+    hal::Spi spi(m_spi_path);
+    spi.set_attribute_cache(&cache);
+
+    const auto attributes = hal::Spi::Attributes().set_frequency(4000000);
+    TEST_ASSERT(spi.set_attributes(attributes).is_success());
+    TEST_ASSERT(spi.set_attributes(attributes).is_success());
+    TEST_ASSERT(cache.miss_count() == 1 && cache.hit_count() == 1);
+    TEST_ASSERT(m_spi.frequency() == 4000000 && spi.width() == 8);
+
+    TEST_ASSERT(
+      spi.set_attributes(hal::Spi::Attributes().set_frequency(8000000))
+        .is_success());
+    TEST_ASSERT(cache.miss_count() == 2 && m_spi.frequency() == 8000000);
+
+    spi.invalidate_attribute_cache();
+    TEST_ASSERT(spi.set_attributes(attributes).is_success());
+    TEST_ASSERT(cache.miss_count() == 3 && m_spi.frequency() == 4000000);
+
+    // a second handle on the same device shares the entry
+    hal::Spi other(m_spi_path);
+    other.set_attribute_cache(&cache);
+    TEST_ASSERT(other.set_attributes(attributes).is_success());
+    TEST_ASSERT(cache.hit_count() == 2);
+    TEST_ASSERT(
+      other.set_attributes(hal::Spi::Attributes().set_frequency(2000000))
+        .is_success());
+    TEST_ASSERT(spi.set_attributes(attributes).is_success());
+    TEST_ASSERT(cache.miss_count() == 5 && m_spi.frequency() == 4000000);
+    return true;
+  }
+
+  bool byte_buffer_ring_api_case() {
+    m_byte_buffer.flush();
+    hal::ByteBuffer fifo(m_byte_buffer_path);
+    hal::ByteBufferRing<8> ring;
+
+    const u8 data[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12};
+    TEST_ASSERT(fifo.write(var::View(data, 6)).is_success());
+    TEST_ASSERT(ring.drain(fifo) == 6);
+    TEST_ASSERT(ring.commit(6).is_empty());
+
+    // the next drain wraps around the end of the ring
+    TEST_ASSERT(fifo.write(var::View(data + 6, 6)).is_success());
+    TEST_ASSERT(ring.drain(fifo) == 6);
+    TEST_ASSERT(ring.is_success());
+    const auto peek = ring.peek();
+    TEST_ASSERT(peek.first().size() == 2 && peek.second().size() == 4);
+    TEST_ASSERT(peek.first() == var::View(data + 6, 2));
+    TEST_ASSERT(peek.second() == var::View(data + 8, 4));
+
+    // an empty fifo is not an error
+    TEST_ASSERT(ring.drain(fifo) == 0);
+    TEST_ASSERT(ring.is_success() && ring.count() == 6);
+    return true;
+  }
+
+  bool buffer_map_api_case() {
+    m_byte_buffer.flush();
+    hal::ByteBuffer fifo(m_byte_buffer_path);
+    auto writeblock = hal::ByteBuffer::Attributes().set_writeblock();
+    auto overwrite = hal::ByteBuffer::Attributes().set_overflow();
+    const u8 data[] = {1, 2, 3, 4, 5, 6};
+
+    {
+      // an overwriting fifo can change under the mapping
+      hal::BufferMap map(m_byte_buffer);
+      api::ErrorScope error_scope;
+      TEST_ASSERT(map.acquire().is_empty());
+      TEST_ASSERT(map.is_error() && map.error().error_number() == EINVAL);
+    }
+
+    TEST_ASSERT(fifo.set_attributes(writeblock).is_success());
+    TEST_ASSERT(fifo.write(var::View(data)).is_success());
+    {
+      hal::BufferMap map(m_byte_buffer);
+      const auto region = map.acquire();
+      TEST_ASSERT(map.is_mapped() && region.size() == sizeof(data));
+      TEST_ASSERT(region.first() == var::View(data));
+      TEST_ASSERT(map.release(4).acquire().size() == 2);
+      TEST_ASSERT(map.release(2).is_success());
+      TEST_ASSERT(m_byte_buffer.frame_count_ready() == 0);
+    }
+    TEST_ASSERT(fifo.set_attributes(overwrite).is_success());
+
+    // without a mapping the data is copied in fallback sized reads
+    TEST_ASSERT(fifo.write(var::View(data)).is_success());
+    hal::BufferMap fallback(fifo, 4);
+    TEST_ASSERT(!fallback.is_mapped());
+    TEST_ASSERT(fallback.acquire().first() == var::View(data, 4));
+    TEST_ASSERT(
+      fallback.release(4).acquire().first() == var::View(data + 4, 2));
+    TEST_ASSERT(fallback.release(2).acquire().is_empty());
+    TEST_ASSERT(fallback.is_success());
+    return true;
+  }
+
+  bool byte_buffer_array_api_case() {
+    using Operation = hal::DeviceStatistics::Operation;
+    hal::DeviceStatistics statistics;
+    hal::ByteBufferArray cfifo(m_byte_buffer_array_path);
+    cfifo.set_statistics(&statistics);
+
+    const auto info = cfifo.get_info();
+    TEST_ASSERT(cfifo.is_success() && info.count() == 4);
+    TEST_ASSERT(info.size() == 16 && info.o_ready() == 0);
+
+    // the location selects the channel
+    const u8 data[] = {1, 2, 3};
+    TEST_ASSERT(cfifo.seek(1).write(var::View(data)).is_success());
+    TEST_ASSERT(cfifo.seek(3).write(var::View(data, 1)).is_success());
+    TEST_ASSERT(cfifo.get_info(1).size_ready() == sizeof(data));
+
+    // only the ready channels are asked for their fifo info
+    statistics.reset();
+    const auto channels = cfifo.get_channel_info();
+    TEST_ASSERT(cfifo.is_success() && channels.count() == 4);
+    TEST_ASSERT(channels.info().o_ready() == ((1 << 1) | (1 << 3)));
+    TEST_ASSERT(channels.at(0).size_ready() == 0);
+    TEST_ASSERT(channels.at(1).size_ready() == sizeof(data));
+    TEST_ASSERT(channels.at(3).size_ready() == 1);
+    TEST_ASSERT(!channels.at(4).is_valid());
+    TEST_ASSERT(
+      statistics.find(Operation::ioctl, I_CFIFO_GETINFO)->call_count() == 1);
+    TEST_ASSERT(
+      statistics.find(Operation::ioctl, I_CFIFO_FIFOGETINFO)->call_count()
+      == 2);
+
+    u8 received[sizeof(data)] = {};
+    TEST_ASSERT(cfifo.seek(1).read(var::View(received)).return_value() == 3);
+    TEST_ASSERT(var::View(received) == var::View(data));
+    TEST_ASSERT(cfifo.flush(3).get_info().o_ready() == 0);
+
+    // an overwritten channel reports the overflow with its level
+    u8 burst[20] = {};
+    TEST_ASSERT(cfifo.seek(0).write(var::View(burst)).is_success());
+    const auto overflowed = cfifo.get_channel_info().at(0);
+    TEST_ASSERT(overflowed.is_overflow() && overflowed.size_ready() == 16);
+    TEST_ASSERT(cfifo.flush(0).is_success());
+
+    TEST_ASSERT(cfifo.set_owner(2, 5).get_owner(2) == 5);
+    return true;
+  }
+
+  bool frame_buffer_reader_api_case() {
+    m_frame_buffer.flush();
+    hal::FrameBuffer frame_buffer(m_frame_buffer_path);
+    hal::FrameBufferReader reader(frame_buffer);
+    TEST_ASSERT(reader.is_success());
+    TEST_ASSERT(reader.frame_size() == frame_size);
+    TEST_ASSERT(reader.frame_count() == frame_count);
+
+    // an empty fifo gives an empty range, not an error
+    TEST_ASSERT(reader.read().is_empty() && reader.is_success());
+    TEST_ASSERT(reader.frames().begin() == reader.frames().end());
+
+    u8 data[3 * frame_size];
+    for (u32 i = 0; i < sizeof(data); i++) {
+      data[i] = i;
+    }
+    TEST_ASSERT(frame_buffer.write(var::View(data)).is_success());
+
+    const auto &frames = reader.read();
+    TEST_ASSERT(frames.count() == 3);
+    TEST_ASSERT(frames.view() == var::View(data));
+    TEST_ASSERT(m_frame_buffer.frame_count_ready() == 0);
+    u32 count = 0;
+    for (const auto frame : frames) {
+      TEST_ASSERT(frame.size() == frame_size);
+      TEST_ASSERT(frame == var::View(data + count * frame_size, frame_size));
+      count++;
+    }
+    TEST_ASSERT(count == 3);
+
+    // frames are views into one arena that each read reuses
+    const void *arena = frames.view().to_const_void();
+    TEST_ASSERT(frame_buffer.write(var::View(data, frame_size)).is_success());
+    TEST_ASSERT(reader.read().count() == 1);
+    TEST_ASSERT(reader.frames().view().to_const_void() == arena);
+    TEST_ASSERT(reader.frames().at(0).to_const_u8()[0] == 0);
+
+    // a full fifo that wrapped is read in order with one call
+    for (u32 i = 0; i < frame_count + 2; i++) {
+      u8 frame[frame_size];
+      var::View(frame).fill<u8>(i);
+      TEST_ASSERT(frame_buffer.write(var::View(frame)).is_success());
+    }
+    TEST_ASSERT(reader.read().count() == frame_count);
+    for (u32 i = 0; i < frame_count; i++) {
+      TEST_ASSERT(reader.frames().at(i).to_const_u8()[0] == i + 2);
+    }
+
+    // a smaller arena takes what fits and leaves the rest ready
+    TEST_ASSERT(frame_buffer.write(var::View(data)).is_success());
+    hal::FrameBufferReader partial(frame_buffer, 2);
+    TEST_ASSERT(partial.read().count() == 2);
+    TEST_ASSERT(m_frame_buffer.frame_count_ready() == 1);
+    TEST_ASSERT(reader.read().count() == 1);
+    TEST_ASSERT(
+      reader.frames().at(0) == var::View(data + 2 * frame_size, frame_size));
+    return true;
+  }
+
+  bool frame_pool_api_case() {
+    m_frame_buffer.flush();
+    hal::FrameBuffer frame_buffer(m_frame_buffer_path);
+    auto writeblock = hal::FrameBuffer::Attributes().set_writeblock();
+    auto overwrite = hal::FrameBuffer::Attributes().set_overflow();
+    hal::FramePool pool(frame_buffer);
+    hal::FrameBufferReader reader(frame_buffer);
+    TEST_ASSERT(pool.is_success() && reader.is_success());
+    TEST_ASSERT(pool.frame_count() == frame_count);
+    TEST_ASSERT(pool.frame_size() == frame_size);
+
+    u32 write_count = 0;
+    mcu_action_t action = {
+      .o_events = MCU_EVENT_FLAG_DATA_READY,
+      .handler = {.callback = count_notify, .context = &write_count}};
+    TEST_ASSERT(frame_buffer.ioctl(I_MCU_SETACTION, &action).is_success());
+
+    // a batch of three goes out with one write
+    pool.set_batch_count(3);
+    for (u8 i = 0; i < 5; i++) {
+      auto frame = pool.acquire();
+      TEST_ASSERT(frame.size() == frame_size);
+      frame.fill<u8>(i);
+      TEST_ASSERT(pool.submit().is_success());
+    }
+    TEST_ASSERT(write_count == 1);
+    TEST_ASSERT(m_frame_buffer.frame_count_ready() == 3);
+    TEST_ASSERT(pool.submitted_count() == 2);
+    TEST_ASSERT(pool.flush().submitted_count() == 0);
+    TEST_ASSERT(write_count == 2);
+
+    const auto &frames = reader.read();
+    TEST_ASSERT(frames.count() == 5);
+    for (u8 i = 0; i < 5; i++) {
+      TEST_ASSERT(frames.at(i).to_const_u8()[frame_size - 1] == i);
+    }
+
+    // a run that wraps past the end of the arena takes two writes
+    pool.set_batch_count(frame_count);
+    write_count = 0;
+    for (u8 i = 5; i < 11; i++) {
+      auto frame = pool.acquire();
+      frame.fill<u8>(i);
+      TEST_ASSERT(pool.submit().is_success());
+    }
+    TEST_ASSERT(pool.flush().is_success() && write_count == 2);
+    TEST_ASSERT(reader.read().count() == 6);
+    for (u8 i = 0; i < 6; i++) {
+      TEST_ASSERT(reader.frames().at(i).to_const_u8()[0] == i + 5);
+    }
+
+    // frames are submitted in the order they were acquired
+    {
+      api::ErrorScope error_scope;
+      TEST_ASSERT(pool.submit().is_error());
+      TEST_ASSERT(pool.error().error_number() == EINVAL);
+    }
+
+    // a full fifo holds frames back until the pool runs out
+    TEST_ASSERT(frame_buffer.set_attributes(writeblock).is_success());
+    pool.set_batch_count(1);
+    for (u32 i = 0; i < 2 * frame_count; i++) {
+      TEST_ASSERT(pool.acquire().size() == frame_size);
+      TEST_ASSERT(pool.submit().is_success());
+    }
+    TEST_ASSERT(pool.free_count() == 0);
+    TEST_ASSERT(pool.acquire().size() == 0 && pool.is_success());
+
+    // draining the fifo makes room for the held frames
+    TEST_ASSERT(reader.read().count() == frame_count);
+    TEST_ASSERT(pool.flush().submitted_count() == 0);
+    TEST_ASSERT(pool.free_count() == frame_count);
+    TEST_ASSERT(frame_buffer.set_attributes(overwrite).flush().is_success());
+
+    // write_count goes out of scope with the case
+    action = {};
+    TEST_ASSERT(frame_buffer.ioctl(I_MCU_SETACTION, &action).is_success());
+    return true;
+  }
+
+  bool frame_stream_pipeline_api_case() {
+    hal::FrameStream stream(m_stream_path);
+    TEST_ASSERT(stream.stop().flush().start().is_success());
+
+    u8 frames[4 * frame_size];
+    fill_frames(frames, 0);
+    TEST_ASSERT(stream.write(var::View(frames)).is_success());
+
+    Collector collector;
+    hal::FrameStreamPipeline pipeline(
+      stream,
+      hal::FrameStreamPipeline::Construct().set_queue_depth(2));
+    pipeline
+      .add_stage(hal::FrameStreamPipeline::Stage().set_function(invert_even))
+      .set_sink(hal::FrameStreamPipeline::Sink()
+                  .set_function(collect)
+                  .set_context(&collector));
+    TEST_ASSERT(pipeline.is_success() && pipeline.stage_count() == 1);
+
+    TEST_ASSERT(pipeline.process() == 2);
+    TEST_ASSERT(pipeline.is_success() && pipeline.error_number() == 0);
+    TEST_ASSERT(pipeline.dropped_count() == 2);
+    TEST_ASSERT(collector.count == 2 && collector.last == u8(~2));
+
+    // a sink that refuses frames holds them back in the queues
+    collector = Collector();
+    collector.limit = 1;
+    fill_frames(frames, 4);
+    TEST_ASSERT(stream.write(var::View(frames)).is_success());
+    TEST_ASSERT(pipeline.process() == 1);
+    TEST_ASSERT(collector.last == u8(~4));
+    collector.limit = 2;
+    TEST_ASSERT(pipeline.process() == 1);
+    TEST_ASSERT(collector.count == 2 && collector.last == u8(~6));
+    TEST_ASSERT(pipeline.dropped_count() == 4);
+
+    // a stage may give a smaller output frame
+    Collector halves;
+    hal::FrameStreamPipeline chain(
+      stream,
+      hal::FrameStreamPipeline::Construct());
+    chain
+      .add_stage(hal::FrameStreamPipeline::Stage()
+                   .set_function(take_half)
+                   .set_frame_size(frame_size / 2))
+      .add_stage(hal::FrameStreamPipeline::Stage().set_function(invert_even))
+      .set_sink(hal::FrameStreamPipeline::Sink()
+                  .set_function(collect)
+                  .set_context(&halves));
+    fill_frames(frames, 8);
+    TEST_ASSERT(stream.write(var::View(frames)).is_success());
+    TEST_ASSERT(chain.process() == 2 && chain.stage_count() == 2);
+    TEST_ASSERT(halves.last == u8(~10) && halves.size == frame_size / 2);
+
+    // a threaded pipeline is not driven by process()
+    hal::FrameStreamPipeline threaded(
+      stream,
+      hal::FrameStreamPipeline::Construct().set_is_threaded(
+        hal::FrameStreamPipeline::IsThreaded::yes));
+    {
+      api::ErrorScope error_scope;
+      TEST_ASSERT(threaded.process() == 0 && threaded.is_error());
+    }
+    TEST_ASSERT(stream.stop().is_success());
+    return true;
+  }
+
+  bool frame_stream_monitor_api_case() {
+    using Alert = hal::FrameStreamMonitor::Alert;
+    hal::FrameStream stream(m_stream_path);
+    TEST_ASSERT(stream.stop().flush().start().is_success());
+
+    // the emulated peripheral drains transmit at once, so ignore underruns
+    MonitorLog log;
+    hal::FrameStreamMonitor monitor(
+      stream,
+      hal::FrameStreamMonitor::Construct()
+        .set_callback(log_alerts)
+        .set_context(&log)
+        .set_transmit_low_water(0));
+
+    // the first sample only sets the baseline
+    u8 frames[3 * frame_size];
+    fill_frames(frames, 0);
+    TEST_ASSERT(stream.write(var::View(frames)).is_success());
+    TEST_ASSERT(monitor.update().alerts() == Alert::none);
+    TEST_ASSERT(monitor.statistics().receive().frame_count() == 0);
+    TEST_ASSERT(log.count == 0);
+
+    TEST_ASSERT(stream.write(var::View(frames)).is_success());
+    const auto &statistics = monitor.update();
+    TEST_ASSERT(monitor.is_success());
+    TEST_ASSERT(statistics.receive().frame_count() == 3);
+    TEST_ASSERT(statistics.transmit().frame_count() == 3);
+    TEST_ASSERT(statistics.receive().frame_count_ready() == 6);
+    TEST_ASSERT(statistics.drift() == 0);
+    TEST_ASSERT(statistics.alerts() == Alert::none && log.count == 0);
+
+    // one frame short of a full fifo is the default high water
+    TEST_ASSERT(stream.write(var::View(frames).truncate(frame_size))
+                  .is_success());
+    TEST_ASSERT(monitor.update().alerts() == Alert::receive_overrun);
+    TEST_ASSERT(log.count == 1 && log.alerts == Alert::receive_overrun);
+
+    // overflow is counted once per time the flag is raised
+    TEST_ASSERT(stream.write(var::View(frames)).is_success());
+    TEST_ASSERT(monitor.update().alerts() & Alert::receive_overflow);
+    TEST_ASSERT(statistics.receive().overflow_count() == 1);
+    TEST_ASSERT(log.count == 2 && (log.alerts & Alert::receive_overflow));
+    TEST_ASSERT(!(monitor.update().alerts() & Alert::receive_overflow));
+    TEST_ASSERT(stream.write(var::View(frames)).is_success());
+    TEST_ASSERT(monitor.update().receive().overflow_count() == 2);
+
+    // a latched error is counted when it is raised, not on every sample
+    m_stream.set_receive_error(EIO);
+    TEST_ASSERT(monitor.update().alerts() & Alert::receive_error);
+    TEST_ASSERT(statistics.receive().error() == EIO);
+    TEST_ASSERT(monitor.update().receive().error_count() == 1);
+    m_stream.set_receive_error(0);
+    TEST_ASSERT(!(monitor.update().alerts() & Alert::receive_error));
+    m_stream.set_receive_error(EIO);
+    TEST_ASSERT(monitor.update().receive().error_count() == 2);
+    m_stream.set_receive_error(0);
+
+    m_stream.set_transmit_error(EIO);
+    TEST_ASSERT(monitor.update().alerts() & Alert::transmit_error);
+    TEST_ASSERT(statistics.transmit().error_count() == 1);
+    m_stream.set_transmit_error(0);
+
+    // a drained fifo raises nothing
+    u8 buffer[frame_count * frame_size];
+    TEST_ASSERT(stream.read(var::View(buffer)).is_success());
+    const u32 count = log.count;
+    TEST_ASSERT(monitor.update().alerts() == Alert::none);
+    TEST_ASSERT(log.count == count);
+
+    // after reset the next sample is a new baseline
+    TEST_ASSERT(monitor.reset().statistics().receive().error_count() == 0);
+    TEST_ASSERT(stream.write(var::View(frames)).is_success());
+    TEST_ASSERT(monitor.update().receive().frame_count() == 0);
+    TEST_ASSERT(stream.stop().flush().is_success());
+    return true;
+  }
+
+  bool frame_stream_group_api_case() {
+    hal::FrameStream first(m_stream_path);
+    hal::FrameStream second(m_group_stream_path);
+    const auto is_running = [](const hal::FrameStream &stream) {
+      return stream.get_info().info().o_status == STREAM_FFIFO_FLAG_START;
+    };
+    const auto frame_count_ready = [](const hal::FrameStream &stream) {
+      return stream.get_info().info().rx.ffifo.frame_count_ready;
+    };
+
+    // an empty group has nothing to start
+    hal::FrameStreamGroup empty;
+    TEST_ASSERT(empty.start().is_success());
+    TEST_ASSERT(empty.maximum_skew().microseconds() == 0);
+
+    // prepare() stops and drains every stream ahead of the start
+    u8 frames[2 * frame_size];
+    fill_frames(frames, 0);
+    TEST_ASSERT(first.stop().flush().start().is_success());
+    TEST_ASSERT(first.write(var::View(frames)).is_success());
+    TEST_ASSERT(frame_count_ready(first) == 2);
+
+    hal::FrameStreamGroup group;
+    TEST_ASSERT(group.add(first).add(second).prepare().is_success());
+    TEST_ASSERT(group.count() == 2 && group.failed_index() == 2);
+    TEST_ASSERT(!is_running(first) && frame_count_ready(first) == 0);
+
+    TEST_ASSERT(group.start().is_success());
+    TEST_ASSERT(group.failed_index() == group.count());
+    TEST_ASSERT(is_running(first) && is_running(second));
+    TEST_ASSERT(group.skew(0).microseconds() == 0);
+    TEST_ASSERT(group.skew(1) >= group.skew(0));
+    TEST_ASSERT(group.maximum_skew() == group.skew(1));
+    TEST_ASSERT(group.skew(2).microseconds() == 0);
+    TEST_ASSERT(!group.stop().is_error());
+    TEST_ASSERT(!is_running(first) && !is_running(second));
+
+    // a stream that fails to start leaves none running
+    hal::FrameStream closed;
+    hal::FrameStreamGroup partial;
+    partial.add(first).add(closed);
+    {
+      api::ErrorScope error_scope;
+      TEST_ASSERT(partial.start().is_error());
+      TEST_ASSERT(partial.failed_index() == 1);
+    }
+    TEST_ASSERT(!is_running(first));
+
+    // the group holds a fixed number of streams
+    hal::FrameStreamGroup full;
+    for (size_t i = 0; i < hal::FrameStreamGroup::maximum_count; i++) {
+      full.add(first);
+    }
+    {
+      api::ErrorScope error_scope;
+      TEST_ASSERT(full.add(second).is_error());
+      TEST_ASSERT(full.error().error_number() == ENOSPC);
+    }
+    TEST_ASSERT(full.count() == hal::FrameStreamGroup::maximum_count);
+    return true;
+  }
+
+  bool timestamped_frame_reader_api_case() {
+    hal::FrameStream stream(m_stream_path);
+    TEST_ASSERT(stream.stop().flush().start().is_success());
+    hal::TimestampedFrameReader reader(stream);
+    TEST_ASSERT(reader.is_success());
+    TEST_ASSERT(reader.read().is_empty() && reader.is_success());
+
+    u8 frames[5 * frame_size];
+    fill_frames(frames, 0);
+    TEST_ASSERT(stream.write(var::View(frames, 3 * frame_size)).is_success());
+    TEST_ASSERT(reader.read().count() == 3);
+    u32 sequence = 0;
+    for (const auto frame : reader.frames()) {
+      TEST_ASSERT(frame.sequence() == sequence);
+      TEST_ASSERT(frame.view().size() == frame_size);
+      TEST_ASSERT(frame.view().to_const_u8()[0] == sequence);
+      sequence++;
+    }
+    TEST_ASSERT(sequence == 3);
+    TEST_ASSERT(reader.statistics().period().microseconds() == 0);
+
+    // the period comes from the frames filled between reads
+    chrono::wait(chrono::MicroTime(20000));
+    TEST_ASSERT(stream.write(var::View(frames, 2 * frame_size)).is_success());
+    const auto &pair = reader.read();
+    TEST_ASSERT(pair.count() == 2 && pair.at(0).sequence() == 3);
+    const auto period = reader.statistics().period();
+    TEST_ASSERT(period >= chrono::MicroTime(10000));
+    TEST_ASSERT(pair.at(1).timestamp() - pair.at(0).timestamp() == period);
+    TEST_ASSERT(reader.statistics().gap_count() == 0);
+
+    // ten more frames overrun the eight frame receive fifo
+    TEST_ASSERT(stream.write(var::View(frames)).is_success());
+    TEST_ASSERT(stream.write(var::View(frames)).is_success());
+    TEST_ASSERT(reader.read().count() == frame_count);
+    TEST_ASSERT(reader.frames().at(0).sequence() == 7);
+    TEST_ASSERT(reader.statistics().gap_count() == 1);
+    TEST_ASSERT(reader.statistics().dropped_count() == 2);
+    TEST_ASSERT(reader.statistics().frame_count() == 13);
+
+    // a restart begins a new sequence rather than a gap
+    TEST_ASSERT(stream.stop().start().is_success());
+    TEST_ASSERT(stream.write(var::View(frames, 2 * frame_size)).is_success());
+    TEST_ASSERT(reader.read().count() == 2);
+    TEST_ASSERT(reader.frames().at(0).sequence() == 0);
+    TEST_ASSERT(reader.statistics().gap_count() == 1);
+    TEST_ASSERT(reader.is_success());
+    TEST_ASSERT(stream.stop().is_success());
+    return true;
+  }
+
+  bool spi_transaction_api_case() {
+    hal::Spi spi(m_spi_path);
+    TEST_ASSERT(spi.set_attributes(hal::Spi::Attributes()).is_success());
+
+    const u8 response[] = {0x12, 0x34, 0x56, 0x78};
+    const u8 command[] = {0x9f};
+    u8 id[3] = {};
+    m_spi.set_response(var::View(response));
+    TEST_ASSERT(spi.execute(hal::Spi::Transaction()
+                              .assert_cs()
+                              .write(var::View(command))
+                              .read(var::View(id))
+                              .deassert_cs())
+                  .is_success());
+    TEST_ASSERT(!m_spi.is_cs_asserted());
+    TEST_ASSERT(var::View(id) == var::View(response, sizeof(id)));
+
+    // a full-duplex segment fills the destination
+    u8 exchanged[2] = {};
+    m_spi.set_response(var::View(response));
+    TEST_ASSERT(spi.execute(hal::Spi::Transaction().transfer(
+                              var::View(response, sizeof(exchanged)),
+                              var::View(exchanged)))
+                  .is_success());
+    TEST_ASSERT(exchanged[0] == 0x12 && exchanged[1] == 0x34);
+
+    // a delay segment holds the bus for its duration
+    hal::Emulator::reset_clock();
+    TEST_ASSERT(spi.execute(hal::Spi::Transaction()
+                              .assert_cs()
+                              .delay(chrono::MicroTime(100))
+                              .deassert_cs())
+                  .is_success());
+    TEST_ASSERT(hal::Emulator::clock() == chrono::MicroTime(100));
+
+    // chip select can also be framed outside a transaction, without
+    // reprogramming the rest of the attributes
+    const u32 frequency = m_spi.frequency();
+    TEST_ASSERT(
+      spi.execute(hal::Spi::Transaction().assert_cs()).is_success());
+    TEST_ASSERT(m_spi.is_cs_asserted());
+    TEST_ASSERT(spi.deassert_cs().is_success() && !m_spi.is_cs_asserted());
+    TEST_ASSERT(spi.assert_cs().is_success() && m_spi.is_cs_asserted());
+    TEST_ASSERT(spi.deassert_cs().is_success() && !m_spi.is_cs_asserted());
+    TEST_ASSERT(m_spi.frequency() == frequency);
+
+    {
+      // the sizes of a transfer must match
+      api::ErrorScope error_scope;
+      TEST_ASSERT(spi
+                    .execute(hal::Spi::Transaction().transfer(
+                      var::View(command),
+                      var::View(id)))
+                    .is_error());
+      TEST_ASSERT(spi.error().error_number() == EINVAL);
+    }
+
+    {
+      // a list that does not fit is rejected rather than cut short
+      hal::Spi::Transaction transaction;
+      for (size_t i = 0; i <= hal::Spi::Transaction::maximum_segment_count;
+           i++) {
+        transaction.write(var::View(command));
+      }
+      TEST_ASSERT(!transaction.is_valid());
+      TEST_ASSERT(
+        transaction.count() == hal::Spi::Transaction::maximum_segment_count);
+      api::ErrorScope error_scope;
+      TEST_ASSERT(spi.execute(transaction).is_error());
+      TEST_ASSERT(spi.error().error_number() == EINVAL);
+      TEST_ASSERT(transaction.clear().is_valid() && transaction.count() == 0);
+    }
+    return true;
+  }
+
+  bool spi_bus_api_case() {
+    hal::SpiBus bus(m_spi_path);
+    const auto sensor
+      = bus.add_client(hal::Spi::Attributes().set_frequency(1000000));
+    const auto display
+      = bus.add_client(hal::Spi::Attributes().set_frequency(8000000));
+    TEST_ASSERT(bus.is_success() && bus.client_count() == 2);
+    TEST_ASSERT(sensor == 0 && display == 1);
+    TEST_ASSERT(bus.reconfigure_count() == 0);
+
+    u8 sample[2] = {};
+    const auto read_sample = hal::Spi::Transaction().read(var::View(sample));
+
+    // the attributes are only written when the client changes
+    TEST_ASSERT(bus.execute(sensor, read_sample)
+                  .execute(sensor, read_sample)
+                  .is_success());
+    TEST_ASSERT(bus.reconfigure_count() == 1);
+    TEST_ASSERT(m_spi.frequency() == 1000000);
+
+    TEST_ASSERT(bus.execute(hal::SpiBus::Batch()
+                              .add(display, read_sample)
+                              .add(display, read_sample)
+                              .add(sensor, read_sample))
+                  .is_success());
+    TEST_ASSERT(bus.reconfigure_count() == 3);
+
+    // a changed profile is written the next time the client runs
+    TEST_ASSERT(
+      bus.set_client(sensor, hal::Spi::Attributes().set_frequency(2000000))
+        .execute(sensor, read_sample)
+        .is_success());
+    TEST_ASSERT(bus.reconfigure_count() == 4);
+    TEST_ASSERT(m_spi.frequency() == 2000000);
+
+    {
+      hal::SpiBus::Guard guard(bus, display);
+      TEST_ASSERT(m_spi.frequency() == 8000000);
+      api::ErrorScope error_scope;
+      hal::SpiBus::Guard nested(bus, sensor);
+      TEST_ASSERT(bus.is_error() && bus.error().error_number() == EDEADLK);
+    }
+
+    // the outer guard gave the bus back
+    TEST_ASSERT(bus.execute(sensor, read_sample).is_success());
+    TEST_ASSERT(m_spi.frequency() == 2000000);
+
+    // another thread waits its turn while the bus is held
+    BusRequest request;
+    request.bus = &bus;
+    request.client = display;
+    request.transaction = &read_sample;
+    thread::Thread worker;
+    {
+      hal::SpiBus::Guard guard(bus, sensor);
+      worker = thread::Thread(
+        thread::Thread::Attributes().set_stack_size(2048).set_detach_state(
+          thread::Thread::DetachState::joinable),
+        thread::Thread::Construct()
+          .set_argument(&request)
+          .set_function(execute_on_bus));
+      TEST_ASSERT(worker.is_success());
+      chrono::wait(chrono::MicroTime(10000));
+      TEST_ASSERT(!request.is_done);
+      TEST_ASSERT(m_spi.frequency() == 2000000);
+    }
+    worker.join();
+    TEST_ASSERT(request.is_done && m_spi.frequency() == 8000000);
+
+    {
+      api::ErrorScope error_scope;
+      TEST_ASSERT(bus.execute(bus.client_count(), read_sample).is_error());
+      TEST_ASSERT(bus.error().error_number() == EINVAL);
+    }
+    return true;
+  }
+
+  bool spi_swap_api_case() {
+    hal::Spi spi(m_spi_path);
+    TEST_ASSERT(spi.set_attributes(hal::Spi::Attributes()).width() == 8);
+
+    // 8-bit frames arrive most significant byte first
+    const u8 response[] = {0x12, 0x34, 0x56, 0x78};
+    const u16 source[2] = {0x0102, 0x0304};
+    u16 destination[2] = {};
+    m_spi.set_response(var::View(response));
+    TEST_ASSERT(spi.swap(source, destination, 2).is_success());
+    TEST_ASSERT(destination[0] == 0x1234 && destination[1] == 0x5678);
+
+    // a long run goes out in one exchange through the staging buffer
+    u16 block[64];
+    for (u16 i = 0; i < 64; i++) {
+      block[i] = i;
+    }
+    hal::Emulator::reset_clock();
+    m_spi.set_response(var::View(response));
+    TEST_ASSERT(spi.swap(block, block, 64).is_success());
+    TEST_ASSERT(hal::Emulator::clock().microseconds() > 0);
+    for (u16 i = 0; i < 64; i += 2) {
+      TEST_ASSERT(block[i] == 0x1234 && block[i + 1] == 0x5678);
+    }
+
+    TEST_ASSERT(
+      spi.set_attributes(hal::Spi::Attributes().set_width(32)).width() == 32);
+    {
+      // a 32-bit frame does not fit a u16
+      api::ErrorScope error_scope;
+      TEST_ASSERT(spi.swap(source, destination, 2).is_error());
+      TEST_ASSERT(spi.error().error_number() == EINVAL);
+    }
+
+    // a u32 goes out as two 16-bit frames, most significant first
+    const u16 frames[] = {0x1234, 0x5678};
+    const u32 word_source[1] = {0x01020304};
+    u32 word_destination[1] = {};
+    m_spi.set_response(var::View(frames));
+    TEST_ASSERT(
+      spi.set_attributes(hal::Spi::Attributes().set_width(16)).is_success());
+    TEST_ASSERT(spi.swap(word_source, word_destination, 1).is_success());
+    TEST_ASSERT(word_destination[0] == 0x12345678);
+
+    // frames as wide as the word move as they are
+    m_spi.set_response(var::View(frames));
+    TEST_ASSERT(spi.swap(source, destination, 2).is_success());
+    TEST_ASSERT(destination[0] == 0x1234 && destination[1] == 0x5678);
+
+    // the driver defaults leave the width to the caller
+    TEST_ASSERT(spi.set_attributes().width() == 0);
+    {
+      api::ErrorScope error_scope;
+      TEST_ASSERT(spi.swap(source, destination, 2).is_error());
+      TEST_ASSERT(spi.error().error_number() == EINVAL);
+    }
+    {
+      api::ErrorScope error_scope;
+      TEST_ASSERT(spi.swap(word_source, word_destination, 1, 33).is_error());
+      TEST_ASSERT(spi.error().error_number() == EINVAL);
+    }
+    m_spi.set_response(var::View(response));
+    TEST_ASSERT(spi.swap(source, destination, 2, 8).is_success());
+    TEST_ASSERT(destination[0] == 0x1234 && destination[1] == 0x5678);
+    return true;
+  }
+#endif
+
+#if !defined __link
+  // the fifo loops back: the write of a transfer completes its own read
+  bool transfer_api_case() {
+    using Transfer = hal::DeviceObject::Transfer;
+    using Completion = hal::DeviceObject::Completion;
+    hal::ByteBuffer fifo(m_byte_buffer_path);
+    TEST_ASSERT(fifo.ioctl(I_FIFO_FLUSH).is_success());
+
+    const u8 source[] = {1, 2, 3, 4, 5, 6, 7, 8};
+    u8 destination[sizeof(source)] = {};
+    const Completion completions[] = {Completion::suspend, Completion::poll};
+    for (const auto completion : completions) {
+      var::View(destination).fill<u8>(0);
+      TEST_ASSERT(fifo
+                    .transfer(Transfer()
+                                .set_source(var::View(source))
+                                .set_destination(var::View(destination))
+                                .set_completion(completion)
+                                .set_timeout(chrono::MicroTime(100000)))
+                    .is_success());
+      TEST_ASSERT(var::View(destination) == var::View(source));
+    }
+
+    // nothing is written, so the read is cancelled at the deadline
+    const chrono::MicroTime timeout(20000);
+    for (const auto completion : completions) {
+      chrono::ClockTimer timer;
+      timer.start();
+      api::ErrorScope error_scope;
+      TEST_ASSERT(fifo
+                    .transfer(Transfer()
+                                .set_destination(var::View(destination))
+                                .set_completion(completion)
+                                .set_timeout(timeout))
+                    .is_error());
+      TEST_ASSERT(fifo.error().error_number() == ETIMEDOUT);
+      TEST_ASSERT(timer.micro_time() >= timeout);
+    }
+
+    // the cancelled read did not take the next data
+    var::View(destination).fill<u8>(0);
+    TEST_ASSERT(fifo
+                  .transfer(Transfer()
+                              .set_source(var::View(source))
+                              .set_destination(var::View(destination)))
+                  .is_success());
+    TEST_ASSERT(var::View(destination) == var::View(source));
+    return true;
+  }
+
+  bool aio_ring_api_case() {
+    hal::ByteBuffer fifo(m_byte_buffer_path);
+    TEST_ASSERT(fifo.ioctl(I_FIFO_FLUSH).is_success());
+    hal::AioRing<2, 4> ring;
+    TEST_ASSERT(ring.start(fifo).is_success() && ring.is_running());
+    TEST_ASSERT(ring.pending_count() > 0);
+
+    // nothing has arrived: a timeout is not an error
+    TEST_ASSERT(ring.wait(chrono::MicroTime(10000)).size() == 0);
+    TEST_ASSERT(ring.is_success());
+
+    // buffers come back in the order they were armed, past the wrap
+    const u8 data[] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12};
+    for (u32 i = 0; i < 3; i++) {
+      const var::View chunk(data + 4 * i, 4);
+      TEST_ASSERT(fifo.write(chunk).is_success());
+      TEST_ASSERT(ring.wait(chrono::MicroTime(100000)) == chunk);
+      TEST_ASSERT(ring.release().is_success());
+    }
+
+    TEST_ASSERT(ring.stop().is_success());
+    TEST_ASSERT(!ring.is_running() && ring.pending_count() == 0);
+
+    // the cancelled reads leave new data to the next reader
+    u8 received[4] = {};
+    TEST_ASSERT(fifo.write(var::View(data, 4)).is_success());
+    TEST_ASSERT(fifo.read(var::View(received)).return_value() == 4);
+    TEST_ASSERT(var::View(received) == var::View(data, 4));
+    return true;
+  }
+
+  bool scatter_transfer_api_case() {
+    using ScatterTransfer = hal::DeviceObject::ScatterTransfer;
+    hal::ByteBuffer fifo(m_byte_buffer_path);
+    TEST_ASSERT(fifo.ioctl(I_FIFO_FLUSH).is_success());
+
+    // the chunks end wherever a source or destination view ends
+    const u8 expected[] = {1, 2, 3, 4, 5, 6, 7, 8};
+    const var::Array<var::View, 2> sources
+      = {var::View(expected, 3), var::View(expected + 3, 5)};
+    u8 first[4] = {};
+    u8 second[4] = {};
+    const var::Array<var::View, 2> destinations
+      = {var::View(first), var::View(second)};
+    TEST_ASSERT(fifo
+                  .transfer(ScatterTransfer()
+                              .set_source(sources)
+                              .set_destination(destinations)
+                              .set_timeout(chrono::MicroTime(100000)))
+                  .is_success());
+    TEST_ASSERT(var::View(first) == var::View(expected, 4));
+    TEST_ASSERT(var::View(second) == var::View(expected + 4, 4));
+
+    {
+      api::ErrorScope error_scope;
+      const var::Array<var::View, 1> short_destination = {var::View(first)};
+      TEST_ASSERT(fifo
+                    .transfer(ScatterTransfer()
+                                .set_source(sources)
+                                .set_destination(short_destination))
+                    .is_error());
+      TEST_ASSERT(fifo.error().error_number() == EINVAL);
+    }
+    return true;
+  }
+
+  bool device_selector_api_case() {
+    using Interest = hal::DeviceSelector::Interest;
+    hal::ByteBuffer fifo(m_byte_buffer_path);
+    auto notify = hal::ByteBuffer::Attributes().set_notify_read();
+    TEST_ASSERT(fifo.ioctl(I_FIFO_FLUSH).set_attributes(notify).is_success());
+
+    hal::DeviceSelector selector;
+    const auto index = selector.add(fifo, Interest::read);
+    TEST_ASSERT(selector.is_success() && selector.count() == 1);
+
+    // a new device is reported once in case data is already buffered
+    const auto &added = selector.wait(chrono::MicroTime(10000));
+    TEST_ASSERT(added.count() == 1 && added.at(0).index() == index);
+    TEST_ASSERT(selector.wait(chrono::MicroTime(10000)).count() == 0);
+    TEST_ASSERT(selector.is_success());
+
+    const u8 data[] = {1, 2, 3, 4};
+    TEST_ASSERT(fifo.write(var::View(data)).is_success());
+    const auto &events = selector.wait(chrono::MicroTime(100000));
+    TEST_ASSERT(events.count() == 1 && events.at(0).index() == index);
+    TEST_ASSERT(events.at(0).is_readable() && !events.at(0).is_writable());
+
+    // a removed device is no longer reported
+    u8 received[sizeof(data)] = {};
+    TEST_ASSERT(fifo.read(var::View(received)).is_success());
+    TEST_ASSERT(selector.remove(index).count() == 0);
+    TEST_ASSERT(fifo.write(var::View(data)).is_success());
+    TEST_ASSERT(selector.wait(chrono::MicroTime(10000)).count() == 0);
+    TEST_ASSERT(selector.is_success());
+    TEST_ASSERT(fifo.ioctl(I_FIFO_FLUSH).is_success());
+    return true;
+  }
+
+#if defined __cpp_impl_coroutine
+  struct Exchange {
+    int read_result = 0;
+    int write_result = 0;
+  };
+
+  static hal::DeviceTask
+  read_task(const hal::ByteBuffer &fifo, var::View buffer, Exchange &exchange) {
+    exchange.read_result = co_await fifo.async_read(buffer);
+  }
+
+  static hal::DeviceTask
+  write_task(const hal::ByteBuffer &fifo, var::View data, Exchange &exchange) {
+    exchange.write_result = co_await fifo.async_write(data);
+  }
+
+  static hal::DeviceTask transfer_task(
+    const hal::ByteBuffer &fifo,
+    const hal::DeviceObject::Transfer &transfer,
+    Exchange &exchange) {
+    exchange.read_result = co_await fifo.async_transfer(transfer);
+  }
+
+  bool device_executor_api_case() {
+    hal::ByteBuffer fifo(m_byte_buffer_path);
+    TEST_ASSERT(fifo.ioctl(I_FIFO_FLUSH).is_success());
+
+    // the reader is parked first; if it blocked the thread, the writer
+    // would never run and run() would not return
+    const u8 data[] = {1, 2, 3, 4};
+    u8 received[sizeof(data)] = {};
+    Exchange exchange;
+    hal::DeviceExecutor executor;
+    executor.spawn(read_task(fifo, var::View(received), exchange))
+      .spawn(write_task(fifo, var::View(data), exchange));
+    TEST_ASSERT(executor.run().is_success());
+    TEST_ASSERT(executor.pending_count() == 0);
+    TEST_ASSERT(exchange.write_result == sizeof(data));
+    TEST_ASSERT(exchange.read_result == sizeof(data));
+    TEST_ASSERT(var::View(received) == var::View(data));
+
+    var::View(received).fill<u8>(0);
+    const auto transfer = hal::DeviceObject::Transfer()
+                            .set_source(var::View(data))
+                            .set_destination(var::View(received));
+    TEST_ASSERT(executor.spawn(transfer_task(fifo, transfer, exchange))
+                  .run()
+                  .is_success());
+    TEST_ASSERT(exchange.read_result == sizeof(data));
+    TEST_ASSERT(var::View(received) == var::View(data));
+
+    {
+      api::ErrorScope error_scope;
+      TEST_ASSERT(executor.spawn(hal::DeviceTask()).is_error());
+      TEST_ASSERT(executor.error().error_number() == EINVAL);
+    }
+    return true;
+  }
+#endif
+
+  using EventQueue = hal::DeviceEventQueue<8, 4>;
+
+  struct EventLog {
+    std::atomic<u32> count{0};
+    std::atomic<u32> o_events{0};
+    std::atomic<u32> source{EventQueue::maximum_source_count};
+  };
+
+  // runs on the queue's worker thread
+  static void
+  log_events(void *context, const EventQueue::Event *events, size_t count) {
+    auto *log = reinterpret_cast<EventLog *>(context);
+    for (size_t i = 0; i < count; i++) {
+      log->o_events |= events[i].o_events();
+      log->source = events[i].source();
+    }
+    log->count += count;
+  }
+
+  bool device_event_queue_api_case() {
+    hal::ByteBuffer fifo(m_byte_buffer_path);
+    auto notify = hal::ByteBuffer::Attributes().set_notify_read();
+    TEST_ASSERT(fifo.ioctl(I_FIFO_FLUSH).set_attributes(notify).is_success());
+
+    EventLog log;
+    EventQueue queue;
+    {
+      api::ErrorScope error_scope;
+      TEST_ASSERT(queue.start(EventQueue::Construct()).is_error());
+      TEST_ASSERT(queue.error().error_number() == EINVAL);
+    }
+    TEST_ASSERT(
+      queue
+        .start(
+          EventQueue::Construct().set_handler(log_events).set_context(&log))
+        .is_success());
+    TEST_ASSERT(queue.is_running());
+    const auto source = queue.add(
+      fifo,
+      EventQueue::CreateAction().set_o_events(MCU_EVENT_FLAG_DATA_READY));
+    TEST_ASSERT(queue.is_success());
+
+    const u8 data[] = {1, 2, 3, 4};
+    TEST_ASSERT(fifo.write(var::View(data)).is_success());
+    chrono::ClockTimer timer;
+    timer.start();
+    while (log.count == 0 && timer.micro_time() < chrono::MicroTime(500000)) {
+      chrono::wait(chrono::MicroTime(1000));
+    }
+    TEST_ASSERT(log.count > 0 && log.source == source);
+    TEST_ASSERT(log.o_events & MCU_EVENT_FLAG_DATA_READY);
+
+    // nothing is handled once the worker has exited
+    TEST_ASSERT(!queue.stop().is_running());
+    const u32 count = log.count;
+    TEST_ASSERT(fifo.write(var::View(data)).is_success());
+    chrono::wait(chrono::MicroTime(10000));
+    TEST_ASSERT(log.count == count);
+    TEST_ASSERT(queue.dropped_count() == 0);
+    TEST_ASSERT(fifo.ioctl(I_FIFO_FLUSH).is_success());
+    return true;
+  }
+
+  bool device_signal_coalescer_api_case() {
+    hal::ByteBuffer fifo(m_byte_buffer_path);
+    auto notify = hal::ByteBuffer::Attributes().set_notify_read();
+    TEST_ASSERT(fifo.ioctl(I_FIFO_FLUSH).set_attributes(notify).is_success());
+
+    const chrono::MicroTime window(50000);
+    hal::DeviceSignalCoalescer coalescer(window);
+    const auto index = coalescer.add(
+      fifo,
+      hal::DeviceSignal::CreateAction().set_o_events(
+        MCU_EVENT_FLAG_DATA_READY));
+    TEST_ASSERT(coalescer.is_success() && coalescer.count() == 1);
+
+    // the first event after a quiet period is reported at once
+    const u8 data[] = {1};
+    chrono::ClockTimer timer;
+    timer.start();
+    TEST_ASSERT(fifo.write(var::View(data)).is_success());
+    const auto &leading = coalescer.wait(window);
+    TEST_ASSERT(leading.count() == 1 && leading.at(0).index() == index);
+    TEST_ASSERT(leading.at(0).count() == 1);
+    TEST_ASSERT(timer.micro_time() < window);
+
+    // a burst inside the window is held and reported once it closes
+    for (u32 i = 0; i < 3; i++) {
+      TEST_ASSERT(fifo.write(var::View(data)).is_success());
+    }
+    TEST_ASSERT(coalescer.wait(chrono::MicroTime(5000)).count() == 0);
+    const auto &burst = coalescer.wait();
+    TEST_ASSERT(burst.count() == 1 && burst.at(0).count() == 3);
+    TEST_ASSERT(burst.at(0).o_events() & MCU_EVENT_FLAG_DATA_READY);
+    TEST_ASSERT(timer.micro_time() >= window);
+
+    // without a window every event is reported on its own
+    chrono::wait(window);
+    TEST_ASSERT(coalescer.set_window(index, chrono::MicroTime()).is_success());
+    for (u32 i = 0; i < 2; i++) {
+      timer.restart();
+      TEST_ASSERT(fifo.write(var::View(data)).is_success());
+      const auto &each = coalescer.wait(window);
+      TEST_ASSERT(each.count() == 1 && each.at(0).count() == 1);
+      TEST_ASSERT(timer.micro_time() < window);
+    }
+
+    {
+      api::ErrorScope error_scope;
+      TEST_ASSERT(coalescer.set_window(index + 1, window).is_error());
+      TEST_ASSERT(coalescer.error().error_number() == EINVAL);
+    }
+    TEST_ASSERT(fifo.ioctl(I_FIFO_FLUSH).is_success());
+    return true;
+  }
+
+  struct DelayedWrite {
+    var::StringView path;
+    var::View data;
+    chrono::MicroTime delay;
+  };
+
+  static void *write_later(void *context) {
+    const auto *write = reinterpret_cast<const DelayedWrite *>(context);
+    chrono::wait(write->delay);
+    hal::ByteBuffer(write->path).write(write->data);
+    return nullptr;
+  }
+
+  bool byte_buffer_wait_ready_api_case() {
+    using Watermark = hal::ByteBuffer::Watermark;
+    hal::ByteBuffer fifo(m_byte_buffer_path);
+    auto notify = hal::ByteBuffer::Attributes().set_notify_read();
+    TEST_ASSERT(fifo.ioctl(I_FIFO_FLUSH).set_attributes(notify).is_success());
+
+    const u8 data[] = {1, 2, 3, 4};
+    const auto watermark = Watermark().set_size(sizeof(data)).set_timeout(
+      chrono::MicroTime(20000));
+
+    // data that is already there is reported without waiting
+    TEST_ASSERT(fifo.write(var::View(data)).is_success());
+    TEST_ASSERT(fifo.wait_ready(watermark).size_ready() == sizeof(data));
+    TEST_ASSERT(fifo.ioctl(I_FIFO_FLUSH).is_success());
+
+    // the deadline reports what has arrived so far
+    TEST_ASSERT(fifo.write(var::View(data, 2)).is_success());
+    chrono::ClockTimer timer;
+    timer.start();
+    TEST_ASSERT(fifo.wait_ready(watermark).size_ready() == 2);
+    TEST_ASSERT(fifo.is_success() && timer.micro_time() >= watermark.timeout());
+
+    // a write from another thread wakes the waiting one
+    const DelayedWrite write = {
+      .path = m_byte_buffer_path,
+      .data = var::View(data + 2, 2),
+      .delay = chrono::MicroTime(5000)};
+    thread::Thread writer(
+      thread::Thread::Attributes().set_stack_size(2048).set_detach_state(
+        thread::Thread::DetachState::joinable),
+      thread::Thread::Construct()
+        .set_argument((void *)&write)
+        .set_function(write_later));
+    TEST_ASSERT(writer.is_success());
+    const chrono::MicroTime timeout(1000000);
+    timer.restart();
+    const auto info
+      = fifo.wait_ready(Watermark(watermark).set_timeout(timeout));
+    writer.join();
+    TEST_ASSERT(info.size_ready() == sizeof(data));
+    TEST_ASSERT(timer.micro_time() < timeout);
+    TEST_ASSERT(fifo.ioctl(I_FIFO_FLUSH).is_success());
+    return true;
+  }
+#endif
 };
@@ -24,7 +24,7 @@ int main(int argc, char *argv[]) {
                            .set_git_hash(SOS_GIT_HASH)
                            .set_printer(&printer));
 
-  { UnitTest(cli.get_name()).execute(cli); }
+  { UnitTest(cli).execute(cli); }
 
   test::Test::finalize();
 